@@ -0,0 +1,193 @@
+#include "place.h"
+#include "win.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+// Runs only the placement stage of src/place.c on synthetic floating windows
+// and reports its cost per window for growing window counts, so that the
+// growth of each scenario shows up next to the count.
+
+#define SCREEN_WIDTH 3840
+#define SCREEN_HEIGHT 2160
+#define LABEL_WIDTH 12
+#define LABEL_HEIGHT 20
+
+typedef struct scenario
+{
+    const char *name;
+    void (*layout)(Window *win, size_t i, size_t count);
+} Scenario;
+
+// windows scattered over the screen, shrinking as their number grows so that
+// each one overlaps a few others
+static void spread(Window *win, size_t i, size_t count)
+{
+    (void) i;
+    int side = 1;
+    while ((size_t) side * side < count)
+    {
+        side++;
+    }
+
+    win->rect.width = SCREEN_WIDTH / side + rand() % (SCREEN_WIDTH / side);
+    win->rect.height = SCREEN_HEIGHT / side + rand() % (SCREEN_HEIGHT / side);
+    win->rect.x = rand() % (SCREEN_WIDTH - win->rect.width);
+    win->rect.y = rand() % (SCREEN_HEIGHT - win->rect.height);
+}
+
+// a cascade where every window overlaps all the others, none is covered
+static void cascade(Window *win, size_t i, size_t count)
+{
+    win->rect.width = SCREEN_WIDTH / 2;
+    win->rect.height = SCREEN_HEIGHT / 2;
+    win->rect.x = (int) (i * (SCREEN_WIDTH / 2) / count);
+    win->rect.y = (int) (i * (SCREEN_HEIGHT / 2) / count);
+}
+
+// windows of the same size on the same spot, all but the top one are dropped
+static void pile(Window *win, size_t i, size_t count)
+{
+    (void) i;
+    (void) count;
+    win->rect.width = 800;
+    win->rect.height = 600;
+    win->rect.x = 100;
+    win->rect.y = 100;
+}
+
+// tiles of a wide grid covering the lower ones, every label in one corner
+static void tiles(Window *win, size_t i, size_t count)
+{
+    (void) count;
+    win->rect.width = 400;
+    win->rect.height = 300;
+    win->rect.x = (int) (i % 8) * 50;
+    win->rect.y = (int) (i / 8 % 8) * 40;
+}
+
+static const Scenario scenarios[] = {
+    {"spread", spread},
+    {"cascade", cascade},
+    {"pile", pile},
+    {"tiles", tiles}};
+
+static long long monotonic_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static Window *make_windows(const Scenario *scenario, size_t count)
+{
+    Window *windows = NULL;
+    Window **link = &windows;
+    size_t i;
+    for (i = 0; i < count; i++)
+    {
+        Window *win = calloc(1, sizeof(Window));
+        if (win == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+
+        win->id = i + 1;
+        win->floating = 1;
+        win->stacking = i;
+        scenario->layout(win, i, count);
+        win->position.x = win->rect.x;
+        win->position.y = win->rect.y;
+        *link = win;
+        link = &win->next;
+    }
+
+    return windows;
+}
+
+static void run_scenario(const Scenario *scenario, size_t count, int iterations)
+{
+    long long elapsed = 0;
+    size_t kept = 0;
+    int i;
+    for (i = 0; i < iterations; i++)
+    {
+        srand(1);
+        Window *windows = make_windows(scenario, count);
+        long long start = monotonic_ns();
+        windows = drop_occluded_windows(windows);
+        place_windows(windows, LABEL_WIDTH, LABEL_HEIGHT);
+        elapsed += monotonic_ns() - start;
+        kept = window_count(windows);
+        window_free(windows);
+    }
+
+    double per_call = (double) elapsed / iterations;
+    printf("%-10s %8lu %8lu %14.0f %16.2f\n",
+           scenario->name,
+           (unsigned long) count,
+           (unsigned long) kept,
+           per_call / 1000,
+           per_call / count);
+}
+
+static void print_help(void)
+{
+    fprintf(stderr, "Usage: bench-place [-n <iterations>] [-m <max windows>] [scenario]\n");
+    fprintf(stderr, " -h            show this message\n");
+    fprintf(stderr, " -n <n>        placements per window count (default: 10)\n");
+    fprintf(stderr, " -m <n>        largest window count, doubled from 64 (default: 4096)\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int iterations = 10;
+    size_t max_windows = 4096;
+    int o;
+    while ((o = getopt(argc, argv, "hn:m:")) != -1)
+    {
+        switch (o)
+        {
+        case 'h':
+            print_help();
+            exit(0);
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        case 'm':
+            max_windows = (size_t) atol(optarg);
+            break;
+        default:
+            print_help();
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (iterations <= 0 || max_windows < 64)
+    {
+        print_help();
+        exit(EXIT_FAILURE);
+    }
+
+    printf("%-10s %8s %8s %14s %16s\n", "scenario", "windows", "kept", "us/placement", "ns/window");
+    size_t s;
+    for (s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++)
+    {
+        if (optind < argc && strcmp(argv[optind], scenarios[s].name) != 0)
+        {
+            continue;
+        }
+
+        size_t count;
+        for (count = 64; count <= max_windows; count *= 2)
+        {
+            run_scenario(&scenarios[s], count, iterations);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,220 @@
+#include "walk.h"
+#include "tree.h"
+#include "win.h"
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <getopt.h>
+#include <json-glib/json-glib.h>
+
+// Runs only the visibility walk of src/walk.c against a fixture produced by
+// gen-tree and reports the cost per container in the tree.
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static int counting = 0;
+static unsigned long allocations = 0;
+
+void *malloc(size_t size)
+{
+    if (counting)
+        __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    if (counting)
+        __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    if (counting)
+        __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+
+typedef struct scenario
+{
+    const char *name;
+    SearchArea search_area;
+    SortMethod sort_method;
+    int threads;
+} Scenario;
+
+// the serial scenarios are the baseline of the parallel walk of --all
+static const Scenario scenarios[] = {
+    {"current-output", CURRENT_OUTPUT, BY_LOCATION, 1},
+    {"all-by-location-1", ALL_OUTPUTS, BY_LOCATION, 1},
+    {"all-by-location", ALL_OUTPUTS, BY_LOCATION, WALK_MAX_THREADS},
+    {"all-by-number-1", ALL_OUTPUTS, BY_NUMBER, 1},
+    {"all-by-number", ALL_OUTPUTS, BY_NUMBER, WALK_MAX_THREADS},
+    {"current-container", CURRENT_CONTAINER, BY_LOCATION, 1},
+    {"everywhere", EVERYWHERE, BY_NUMBER, WALK_MAX_THREADS}};
+
+static long long monotonic_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static unsigned long count_containers(JsonObject *con)
+{
+    unsigned long count = 1;
+    const char *members[] = {"nodes", "floating_nodes"};
+
+    size_t m;
+    for (m = 0; m < 2; m++)
+    {
+        JsonArray *children = json_object_get_array_member(con, members[m]);
+        guint i;
+        for (i = 0; i < json_array_get_length(children); i++)
+        {
+            count += count_containers(json_array_get_object_element(children, i));
+        }
+    }
+
+    return count;
+}
+
+static unsigned long count_windows(Window *win)
+{
+    unsigned long count = 0;
+    for (; win != NULL; win = win->next)
+    {
+        count++;
+    }
+
+    return count;
+}
+
+// the parallel walk must produce the same windows in the same order
+static int same_as_serial(const Scenario *scenario, Tree *tree)
+{
+    walk_set_max_threads(1);
+    Window *serial = walk_visible_windows(tree, scenario->search_area, scenario->sort_method, NULL, ORDER_TREE);
+    walk_set_max_threads(scenario->threads);
+    Window *parallel = walk_visible_windows(tree, scenario->search_area, scenario->sort_method, NULL, ORDER_TREE);
+
+    Window *a = serial;
+    Window *b = parallel;
+    while (a != NULL && b != NULL && a->id == b->id && a->position.x == b->position.x && a->position.y == b->position.y)
+    {
+        a = a->next;
+        b = b->next;
+    }
+
+    int same = (a == NULL && b == NULL);
+    window_free(serial);
+    window_free(parallel);
+
+    return same;
+}
+
+static void run_scenario(const Scenario *scenario, Tree *tree, unsigned long containers, int iterations)
+{
+    if (!same_as_serial(scenario, tree))
+    {
+        fprintf(stderr, "%s: parallel walk differs from the serial one\n", scenario->name);
+        exit(EXIT_FAILURE);
+    }
+
+    // warm up caches and let glib allocate its lazily initialised state
+    Window *windows = walk_visible_windows(tree, scenario->search_area, scenario->sort_method, NULL, ORDER_TREE);
+    unsigned long num_windows = count_windows(windows);
+    window_free(windows);
+
+    allocations = 0;
+    counting = 1;
+    long long start = monotonic_ns();
+    int i;
+    for (i = 0; i < iterations; i++)
+    {
+        windows = walk_visible_windows(tree, scenario->search_area, scenario->sort_method, NULL, ORDER_TREE);
+        window_free(windows);
+    }
+    long long elapsed = monotonic_ns() - start;
+    counting = 0;
+
+    double per_walk = (double) elapsed / iterations;
+    printf("%-18s %8lu %10lu %14.2f %18.3f\n",
+           scenario->name,
+           num_windows,
+           containers,
+           per_walk / containers,
+           (double) allocations / iterations / containers);
+}
+
+static void print_help(void)
+{
+    fprintf(stderr, "Usage: bench-walk [-n <iterations>] <fixture.json>\n");
+    fprintf(stderr, " -h            show this message\n");
+    fprintf(stderr, " -n <n>        walks per scenario (default: 1000)\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int iterations = 1000;
+    int o;
+    while ((o = getopt(argc, argv, "hn:")) != -1)
+    {
+        switch (o)
+        {
+        case 'h':
+            print_help();
+            exit(0);
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        default:
+            print_help();
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (optind >= argc || iterations <= 0)
+    {
+        print_help();
+        exit(EXIT_FAILURE);
+    }
+
+    GError *err = NULL;
+    JsonParser *parser = json_parser_new();
+    if (!json_parser_load_from_file(parser, argv[optind], &err))
+    {
+        fprintf(stderr, "cannot load fixture: %s\n", err->message);
+        g_error_free(err);
+        g_object_unref(parser);
+        return 1;
+    }
+
+    JsonObject *fixture = json_node_get_object(json_parser_get_root(parser));
+    JsonObject *tree = json_object_get_object_member(fixture, "tree");
+    Tree *model = tree_from_json(tree);
+    unsigned long containers = count_containers(tree);
+    if (model == NULL)
+    {
+        fprintf(stderr, "cannot build tree from fixture\n");
+        g_object_unref(parser);
+        return 1;
+    }
+
+    printf("%-18s %8s %10s %14s %18s\n", "scenario", "windows", "containers", "ns/container", "allocs/container");
+    size_t i;
+    for (i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+    {
+        run_scenario(&scenarios[i], model, containers, iterations);
+    }
+
+    tree_free(model);
+    g_object_unref(parser);
+
+    return 0;
+}
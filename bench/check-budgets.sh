@@ -0,0 +1,42 @@
+#!/bin/sh
+# Replays a generated session with 36 labels on two outputs (--all) against
+# bench/replay-i3 and Xvfb, first with an empty cache and then with the one
+# the first run filled, and fails if a traced phase goes over its budget in
+# TRACE_BUDGETS of src/config.h.
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+# a fresh cache, so that fonts and the keymap are queried like on a first launch
+XDG_CACHE_HOME=$dir/cache
+export XDG_CACHE_HOME
+
+bench/gen-tree -R -o 2 -w 1 -d 1 -f 16 -t 0 -F 2 -s 0 > "$dir/session.jsonl" || exit 1
+
+for run in uncached cached; do
+    bench/replay.sh "$dir/session.jsonl" --all --trace-strict="$dir/$run.jsonl" \
+        > "$dir/report.txt" 2> "$dir/stderr.txt"
+    status=$?
+
+    if ! grep -q '"phase":"labels".*"items":36,' "$dir/$run.jsonl"; then
+        echo "$run: the 36 labels were not shown:" >&2
+        cat "$dir/$run.jsonl" >&2
+        exit 1
+    fi
+
+    cached=false
+    [ $run = cached ] && cached=true
+    if ! grep -q "\"phase\":\"xcb_init\".*\"cached\":$cached," "$dir/$run.jsonl"; then
+        echo "$run: xcb_init was not traced with \"cached\":$cached" >&2
+        exit 1
+    fi
+
+    if [ $status -ne 0 ]; then
+        grep '"over_budget":true' "$dir/$run.jsonl" >&2
+        cat "$dir/stderr.txt" >&2
+        echo "$run: phases over budget, see TRACE_BUDGETS in src/config.h (exit status: $status)" >&2
+        exit 1
+    fi
+done
+
+echo "all phases within budget, with and without the cache"
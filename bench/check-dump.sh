@@ -0,0 +1,49 @@
+#!/bin/sh
+# Checks that --dump assigns the keys the labels get when they are shown. On
+# a generated workspace with floating windows piled on the same spot, of
+# which only the top one is visible, it dumps the keys, then presses each
+# dumped key in a replayed session with --con-id and fails unless the window
+# that was selected is the one the dump gave that key.
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+XDG_CACHE_HOME=$dir/cache
+export XDG_CACHE_HOME
+
+tree="-o 1 -w 1 -d 1 -f 2 -t 0 -F 3 -s 0 -P"
+
+# replay.sh shares its stdout with the stand-in's report, the dump goes to a
+# file of its own
+cat > "$dir/dump.sh" <<SCRIPT
+#!/bin/sh
+exec ./i3-easyfocus "\$@" > "$dir/dump.tsv"
+SCRIPT
+chmod +x "$dir/dump.sh"
+
+bench/gen-tree -R $tree > "$dir/session.jsonl" || exit 1
+REPLAY_CLIENT=$dir/dump.sh bench/replay.sh "$dir/session.jsonl" --dump=tsv > /dev/null || exit 1
+
+labelled=$(awk -F '\t' '$3 != ""' "$dir/dump.tsv" | wc -l)
+if [ "$labelled" -ne 3 ]; then
+    echo "expected keys for 2 tiled windows and the top floating one:" >&2
+    cat "$dir/dump.tsv" >&2
+    exit 1
+fi
+
+failed=0
+awk -F '\t' '$3 != "" { print $1, $3 }' "$dir/dump.tsv" > "$dir/keys.txt"
+while read -r id key; do
+    keysym=$(printf '%d' "'$key")
+    bench/gen-tree -R -k "$keysym" $tree > "$dir/select.jsonl" || exit 1
+    bench/replay.sh "$dir/select.jsonl" --con-id > "$dir/select.txt" || exit 1
+    if ! grep -qx "$id" "$dir/select.txt"; then
+        echo "key $key selected a different window than window $id of the dump" >&2
+        failed=1
+    fi
+done < "$dir/keys.txt"
+
+if [ $failed -eq 0 ]; then
+    echo "the dumped keys select the same windows"
+fi
+exit $failed
@@ -0,0 +1,127 @@
+#include "xcb.h"
+#include "config.h"
+#include "color_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <xcb/xcb.h>
+#include <xcb/xtest.h>
+
+// Checks that a key pressed while a label waits for its first expose reaches
+// the main loop: the key is grabbed, typed through XTest before the label is
+// mapped, and must come out of xcb_wait_for_user_input afterwards. Needs an X
+// server such as Xvfb, see bench/check-expose.sh.
+
+#define CHECK_KEYSYM 0x61 // a
+#define CHECK_TIMEOUT_S 5
+
+static void timed_out(int sig)
+{
+    (void) sig;
+    static const char message[] = "the key press was lost while waiting for the expose\n";
+    if (write(STDERR_FILENO, message, sizeof(message) - 1) < 0)
+    {
+        // exiting with failure either way
+    }
+    _exit(EXIT_FAILURE);
+}
+
+static xcb_keycode_t keycode_for(xcb_connection_t *conn, xcb_keysym_t keysym)
+{
+    const xcb_setup_t *setup = xcb_get_setup(conn);
+    int count = setup->max_keycode - setup->min_keycode + 1;
+    xcb_get_keyboard_mapping_reply_t *reply = xcb_get_keyboard_mapping_reply(
+        conn, xcb_get_keyboard_mapping(conn, setup->min_keycode, count), NULL);
+    if (reply == NULL)
+    {
+        return 0;
+    }
+
+    xcb_keysym_t *syms = xcb_get_keyboard_mapping_keysyms(reply);
+    xcb_keycode_t keycode = 0;
+    int i;
+    for (i = 0; i < count; i++)
+    {
+        if (syms[i * reply->keysyms_per_keycode] == keysym)
+        {
+            keycode = setup->min_keycode + i;
+            break;
+        }
+    }
+
+    free(reply);
+    return keycode;
+}
+
+// types the key on a connection of its own and waits until the server has
+// sent the events, so they are queued before the label is mapped
+static int type_key(xcb_keysym_t keysym)
+{
+    xcb_connection_t *typist = xcb_connect(NULL, NULL);
+    if (xcb_connection_has_error(typist))
+    {
+        xcb_disconnect(typist);
+        return 1;
+    }
+
+    xcb_keycode_t keycode = keycode_for(typist, keysym);
+    if (keycode != 0)
+    {
+        xcb_test_fake_input(typist, XCB_KEY_PRESS, keycode, XCB_CURRENT_TIME, XCB_NONE, 0, 0, 0);
+        xcb_test_fake_input(typist, XCB_KEY_RELEASE, keycode, XCB_CURRENT_TIME, XCB_NONE, 0, 0, 0);
+        free(xcb_get_input_focus_reply(typist, xcb_get_input_focus(typist), NULL));
+    }
+
+    xcb_disconnect(typist);
+    return keycode == 0;
+}
+
+int main()
+{
+    ColorConfig colors = {COLOR_DEFAULT_URGENT_BG, COLOR_DEFAULT_URGENT_FG, COLOR_DEFAULT_FOCUSED_BG,
+                          COLOR_DEFAULT_FOCUSED_FG, COLOR_DEFAULT_UNFOCUSED_BG, COLOR_DEFAULT_UNFOCUSED_FG};
+    if (xcb_init(XCB_DEFAULT_FONT_NAME, colors))
+    {
+        fprintf(stderr, "cannot connect to X\n");
+        return EXIT_FAILURE;
+    }
+
+    if (xcb_grab_keysym(CHECK_KEYSYM, 0))
+    {
+        fprintf(stderr, "cannot grab the key\n");
+        xcb_finish();
+        return EXIT_FAILURE;
+    }
+
+    if (type_key(CHECK_KEYSYM))
+    {
+        fprintf(stderr, "cannot type the key\n");
+        xcb_finish();
+        return EXIT_FAILURE;
+    }
+
+    xcb_window_t label;
+    if (xcb_create_text_window(10, 10, UNFOCUSED_WINDOW, "a", &label))
+    {
+        fprintf(stderr, "cannot create the label\n");
+        xcb_finish();
+        return EXIT_FAILURE;
+    }
+
+    signal(SIGALRM, timed_out);
+    alarm(CHECK_TIMEOUT_S);
+    xcb_keysym_t selection = xcb_wait_for_user_input();
+    alarm(0);
+    xcb_finish();
+
+    if (selection != CHECK_KEYSYM)
+    {
+        fprintf(stderr, "expected keysym %#x, got %#x\n", CHECK_KEYSYM, selection);
+        return EXIT_FAILURE;
+    }
+
+    printf("the key press before the expose was delivered\n");
+    return 0;
+}
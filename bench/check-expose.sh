@@ -0,0 +1,25 @@
+#!/bin/sh
+# Runs bench/check-expose on an Xvfb display (REPLAY_DISPLAY, default :99)
+# and fails if a key pressed before a label's first expose was lost:
+#
+#   bench/check-expose.sh
+
+display=${REPLAY_DISPLAY:-:99}
+
+dir=$(mktemp -d)
+Xvfb "$display" -screen 0 1920x1080x24 -nolisten tcp >/dev/null 2>&1 &
+xvfb=$!
+trap 'kill $xvfb 2>/dev/null; rm -rf "$dir"' EXIT
+
+tries=0
+while [ ! -S "/tmp/.X11-unix/X${display#:}" ]; do
+    tries=$((tries + 1))
+    if [ $tries -gt 50 ] || ! kill -0 $xvfb 2>/dev/null; then
+        echo "cannot start Xvfb on $display" >&2
+        exit 1
+    fi
+    sleep 0.1
+done
+
+# the font and keymap cache of the user is left alone
+DISPLAY=$display XDG_CACHE_HOME=$dir bench/check-expose
@@ -0,0 +1,37 @@
+#!/bin/sh
+# Replays a generated session with more windows than label keys (--everywhere
+# over 76 windows, reloaded with new windows a few times) against
+# bench/replay-i3 and Xvfb, and fails unless the client labels as many
+# windows as there are keys, skips the rest and ends normally with Escape.
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+XDG_CACHE_HOME=$dir/cache
+export XDG_CACHE_HOME
+
+# 2 outputs with 3 workspaces of 10 tiled and 2 floating windows each, and 4
+# windows in the scratchpad
+bench/gen-tree -R -n 3 -o 2 -w 3 -d 1 -f 10 -t 0 -F 2 -s 4 > "$dir/session.jsonl" || exit 1
+bench/replay.sh "$dir/session.jsonl" --everywhere --trace="$dir/trace.jsonl" \
+    > "$dir/report.txt" 2> "$dir/stderr.txt"
+status=$?
+
+if [ $status -ne 0 ]; then
+    cat "$dir/stderr.txt" >&2
+    echo "the client failed with more windows than keys (exit status: $status)" >&2
+    exit 1
+fi
+
+if ! grep -q '"phase":"labels".*"items":36,' "$dir/trace.jsonl"; then
+    echo "the 36 labels were not shown:" >&2
+    cat "$dir/trace.jsonl" >&2
+    exit 1
+fi
+
+if ! grep -q 'windows have no label' "$dir/stderr.txt"; then
+    echo "the windows without a label were not reported" >&2
+    exit 1
+fi
+
+echo "36 windows labelled, the others skipped"
@@ -0,0 +1,96 @@
+#include "walk.h"
+#include "tree.h"
+#include "win.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <json-glib/json-glib.h>
+
+// Walks the visible windows of every output in a fixture and compares them
+// with the fixture's "expected" list of {id, is_tab, floating}, in order.
+// The fixtures in bench/fixtures cover layouts that gen-tree doesn't produce.
+
+static int check_fixture(const char *path)
+{
+    GError *err = NULL;
+    JsonParser *parser = json_parser_new();
+    if (!json_parser_load_from_file(parser, path, &err))
+    {
+        fprintf(stderr, "%s: cannot load fixture: %s\n", path, err->message);
+        g_error_free(err);
+        g_object_unref(parser);
+        return 1;
+    }
+
+    JsonObject *fixture = json_node_get_object(json_parser_get_root(parser));
+    Tree *tree = tree_from_json(json_object_get_object_member(fixture, "tree"));
+    if (tree == NULL)
+    {
+        fprintf(stderr, "%s: cannot build tree from fixture\n", path);
+        g_object_unref(parser);
+        return 1;
+    }
+
+    walk_set_max_threads(1);
+    Window *windows = walk_visible_windows(tree, ALL_OUTPUTS, BY_LOCATION, NULL, ORDER_TREE);
+    JsonArray *expected = json_object_get_array_member(fixture, "expected");
+
+    int failed = 0;
+    Window *win = windows;
+    guint i;
+    for (i = 0; !failed && i < json_array_get_length(expected); i++, win = win->next)
+    {
+        JsonObject *want = json_array_get_object_element(expected, i);
+        unsigned long id = (unsigned long) json_object_get_int_member(want, "id");
+        int is_tab = json_object_get_boolean_member(want, "is_tab");
+        int floating = json_object_get_boolean_member(want, "floating");
+        if (win == NULL)
+        {
+            fprintf(stderr, "%s: window %lu is missing\n", path, id);
+            failed = 1;
+        }
+        else if (win->id != id || !win->is_tab != !is_tab || !win->floating != !floating)
+        {
+            fprintf(stderr, "%s: expected window %lu (tab: %d, floating: %d), got %lu (tab: %d, floating: %d)\n",
+                    path, id, is_tab, floating, win->id, win->is_tab, win->floating);
+            failed = 1;
+        }
+    }
+
+    if (!failed && win != NULL)
+    {
+        fprintf(stderr, "%s: unexpected window %lu\n", path, win->id);
+        failed = 1;
+    }
+
+    window_free(windows);
+    tree_free(tree);
+    g_object_unref(parser);
+
+    return failed;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: check-walk <fixture.json>...\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int failed = 0;
+    int i;
+    for (i = 1; i < argc; i++)
+    {
+        if (check_fixture(argv[i]))
+        {
+            failed = 1;
+        }
+        else
+        {
+            printf("%s: walked as expected\n", argv[i]);
+        }
+    }
+
+    return failed ? EXIT_FAILURE : 0;
+}
@@ -0,0 +1,477 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+// Generates a synthetic i3 layout as a single JSON document of the form
+// {"tree": <GET_TREE>, "workspaces": <GET_WORKSPACES>, "outputs": <GET_OUTPUTS>},
+// or as a session recording for bench/replay-i3 that shows the labels of the
+// tree, optionally replaces them a number of times, and exits with Escape.
+
+#define OUTPUT_WIDTH 1920
+#define OUTPUT_HEIGHT 1080
+#define DECO_HEIGHT 20
+
+// when the recorded Escape is pressed, relative to the first request
+#define RECORDING_ESCAPE_NS 2000000000LL
+#define RECORDING_ESCAPE_KEYSYM 0xff1b
+#define RECORDING_ESCAPE_KEYCODE 9
+// how often the tree is reloaded with new windows after that
+#define RECORDING_RELOAD_INTERVAL_NS 20000000LL
+
+typedef struct rect
+{
+    int x;
+    int y;
+    int width;
+    int height;
+} Rect;
+
+static int num_outputs = 2;
+static int num_workspaces = 5;
+static int depth = 2;
+static int fanout = 3;
+static int tabbed = 4;
+static int floating = 2;
+static int scratchpad = 2;
+static int pile = 0;
+static int recording = 0;
+static int reloads = 0;
+static long final_keysym = RECORDING_ESCAPE_KEYSYM;
+
+static unsigned long next_id = 1;
+static unsigned long next_window = 0x1000001;
+static unsigned long leaf_counter = 0;
+static int focus_placed = 0;
+
+static const Rect no_rect = {0, 0, 0, 0};
+
+static void print_help(void)
+{
+    fprintf(stderr, "Usage: gen-tree <options>\n");
+    fprintf(stderr, " -h            show this message\n");
+    fprintf(stderr, " -o <n>        number of outputs (default: %d)\n", num_outputs);
+    fprintf(stderr, " -w <n>        workspaces per output (default: %d)\n", num_workspaces);
+    fprintf(stderr, " -d <n>        split nesting depth within a workspace (default: %d)\n", depth);
+    fprintf(stderr, " -f <n>        children per split container (default: %d)\n", fanout);
+    fprintf(stderr, " -t <n>        tabs per tabbed container, 0 disables them (default: %d)\n", tabbed);
+    fprintf(stderr, " -F <n>        floating windows per workspace (default: %d)\n", floating);
+    fprintf(stderr, " -s <n>        windows in the scratchpad (default: %d)\n", scratchpad);
+    fprintf(stderr, " -P            pile the floating windows of a workspace on the same spot\n");
+    fprintf(stderr, " -R            print a session recording for bench/replay-i3 instead\n");
+    fprintf(stderr, " -n <n>        with -R, reload the tree with new windows this often (default: %d)\n", reloads);
+    fprintf(stderr, " -k <keysym>   with -R, end the session with this key instead of Escape\n");
+}
+
+static void print_rect(const char *name, Rect rect)
+{
+    printf("\"%s\":{\"x\":%d,\"y\":%d,\"width\":%d,\"height\":%d},", name, rect.x, rect.y, rect.width, rect.height);
+}
+
+static void print_con_start(unsigned long id, const char *type, const char *name, const char *layout, Rect rect, Rect deco_rect)
+{
+    printf("{\"id\":%lu,\"type\":\"%s\",\"name\":\"%s\",\"layout\":\"%s\",", id, type, name, layout);
+    printf("\"orientation\":\"none\",\"percent\":null,\"border\":\"pixel\",\"current_border_width\":1,");
+    printf("\"urgent\":false,\"sticky\":false,\"floating\":\"auto_off\",\"scratchpad_state\":\"none\",");
+    printf("\"fullscreen_mode\":0,\"marks\":[],\"swallows\":[],");
+    print_rect("rect", rect);
+    print_rect("deco_rect", deco_rect);
+    print_rect("window_rect", no_rect);
+    print_rect("geometry", no_rect);
+}
+
+static void print_focus(const unsigned long *ids, int count)
+{
+    printf("\"focus\":[");
+    int i;
+    for (i = 0; i < count; i++)
+    {
+        printf("%s%lu", i ? "," : "", ids[i]);
+    }
+    printf("]}");
+}
+
+static unsigned long print_leaf(Rect rect, Rect deco_rect)
+{
+    unsigned long id = next_id++;
+    unsigned long window = next_window++;
+    leaf_counter++;
+
+    char name[32];
+    snprintf(name, sizeof(name), "window %lu", leaf_counter);
+    print_con_start(id, "con", name, "splith", rect, deco_rect);
+
+    printf("\"focused\":%s,", focus_placed ? "false" : "true");
+    focus_placed = 1;
+    printf("\"window\":%lu,", window);
+    printf("\"window_properties\":{\"class\":\"%s\",\"instance\":\"%s\",\"title\":\"%s\"},",
+           leaf_counter % 3 ? "XTerm" : "Firefox",
+           leaf_counter % 3 ? "xterm" : "Navigator",
+           name);
+    printf("\"nodes\":[],\"floating_nodes\":[],\"focus\":[]}");
+
+    return id;
+}
+
+static unsigned long print_tabbed(Rect rect)
+{
+    unsigned long id = next_id++;
+    unsigned long *children = malloc(sizeof(unsigned long) * tabbed);
+
+    print_con_start(id, "con", "", "tabbed", rect, no_rect);
+    printf("\"focused\":false,\"window\":null,\"nodes\":[");
+
+    Rect child_rect = {rect.x, rect.y + DECO_HEIGHT, rect.width, rect.height - DECO_HEIGHT};
+    int i;
+    for (i = 0; i < tabbed; i++)
+    {
+        Rect deco_rect = {i * rect.width / tabbed, 0, rect.width / tabbed, DECO_HEIGHT};
+        printf("%s", i ? "," : "");
+        children[i] = print_leaf(child_rect, deco_rect);
+    }
+
+    printf("],\"floating_nodes\":[],");
+    print_focus(children, tabbed);
+    free(children);
+
+    return id;
+}
+
+static unsigned long print_node(int level, Rect rect, int horizontal);
+
+static void print_split_children(int level, Rect rect, int horizontal, unsigned long *children)
+{
+    int i;
+    for (i = 0; i < fanout; i++)
+    {
+        Rect child_rect = rect;
+        if (horizontal)
+        {
+            child_rect.width = rect.width / fanout;
+            child_rect.x = rect.x + i * child_rect.width;
+        }
+        else
+        {
+            child_rect.height = rect.height / fanout;
+            child_rect.y = rect.y + i * child_rect.height;
+        }
+
+        printf("%s", i ? "," : "");
+        children[i] = print_node(level - 1, child_rect, !horizontal);
+    }
+}
+
+static unsigned long print_node(int level, Rect rect, int horizontal)
+{
+    if (level <= 0)
+    {
+        if (tabbed > 0 && leaf_counter % 2 == 1)
+        {
+            return print_tabbed(rect);
+        }
+
+        return print_leaf(rect, no_rect);
+    }
+
+    unsigned long id = next_id++;
+    unsigned long *children = malloc(sizeof(unsigned long) * fanout);
+
+    print_con_start(id, "con", "", horizontal ? "splith" : "splitv", rect, no_rect);
+    printf("\"focused\":false,\"window\":null,\"nodes\":[");
+    print_split_children(level, rect, horizontal, children);
+    printf("],\"floating_nodes\":[],");
+    print_focus(children, fanout);
+    free(children);
+
+    return id;
+}
+
+static unsigned long print_floating_con(Rect rect)
+{
+    unsigned long id = next_id++;
+
+    print_con_start(id, "floating_con", "", "splith", rect, no_rect);
+    printf("\"focused\":false,\"window\":null,\"nodes\":[");
+    unsigned long child = print_leaf(rect, no_rect);
+    printf("],\"floating_nodes\":[],");
+    print_focus(&child, 1);
+
+    return id;
+}
+
+static void print_floating_cons(Rect rect, int count, unsigned long *ids)
+{
+    int i;
+    for (i = 0; i < count; i++)
+    {
+        // piled up, all but the last one are hidden behind it
+        int offset = pile ? 50 : 50 * (i + 1);
+        Rect floating_rect = {rect.x + offset, rect.y + offset, rect.width / 3, rect.height / 3};
+        printf("%s", i ? "," : "");
+        ids[i] = print_floating_con(floating_rect);
+    }
+}
+
+static unsigned long print_workspace(int num, Rect rect)
+{
+    unsigned long id = next_id++;
+    unsigned long *children = malloc(sizeof(unsigned long) * (fanout + floating));
+
+    char name[16];
+    snprintf(name, sizeof(name), "%d", num);
+    print_con_start(id, "workspace", name, "splith", rect, no_rect);
+    printf("\"num\":%d,\"focused\":false,\"window\":null,\"nodes\":[", num);
+    print_split_children(depth, rect, 1, children);
+    printf("],\"floating_nodes\":[");
+    print_floating_cons(rect, floating, children + fanout);
+    printf("],");
+    print_focus(children, fanout + floating);
+    free(children);
+
+    return id;
+}
+
+static unsigned long print_dockarea(const char *name, Rect rect)
+{
+    unsigned long id = next_id++;
+
+    Rect dock_rect = {rect.x, rect.y, rect.width, 0};
+    print_con_start(id, "dockarea", name, "dockarea", dock_rect, no_rect);
+    printf("\"focused\":false,\"window\":null,\"nodes\":[],\"floating_nodes\":[],\"focus\":[]}");
+
+    return id;
+}
+
+static unsigned long print_output(int index)
+{
+    unsigned long id = next_id++;
+    unsigned long children[3];
+
+    char name[16];
+    snprintf(name, sizeof(name), "OUT-%d", index);
+    Rect rect = {index * OUTPUT_WIDTH, 0, OUTPUT_WIDTH, OUTPUT_HEIGHT};
+    print_con_start(id, "output", name, "output", rect, no_rect);
+    printf("\"focused\":false,\"window\":null,\"nodes\":[");
+
+    children[1] = print_dockarea("topdock", rect);
+
+    unsigned long content = next_id++;
+    unsigned long *workspaces = malloc(sizeof(unsigned long) * num_workspaces);
+    printf(",");
+    print_con_start(content, "con", "content", "splith", rect, no_rect);
+    printf("\"focused\":false,\"window\":null,\"nodes\":[");
+    int i;
+    for (i = 0; i < num_workspaces; i++)
+    {
+        printf("%s", i ? "," : "");
+        workspaces[i] = print_workspace(index * num_workspaces + i + 1, rect);
+    }
+    printf("],\"floating_nodes\":[],");
+    print_focus(workspaces, num_workspaces);
+    free(workspaces);
+    children[0] = content;
+
+    printf(",");
+    children[2] = print_dockarea("bottomdock", rect);
+
+    printf("],\"floating_nodes\":[],");
+    print_focus(children, 3);
+
+    return id;
+}
+
+static unsigned long print_scratchpad_output()
+{
+    unsigned long id = next_id++;
+    unsigned long content = next_id++;
+    unsigned long scratch = next_id++;
+    unsigned long *children = malloc(sizeof(unsigned long) * scratchpad);
+    Rect rect = {0, 0, OUTPUT_WIDTH, OUTPUT_HEIGHT};
+
+    print_con_start(id, "output", "__i3", "output", no_rect, no_rect);
+    printf("\"focused\":false,\"window\":null,\"nodes\":[");
+    print_con_start(content, "con", "content", "splith", no_rect, no_rect);
+    printf("\"focused\":false,\"window\":null,\"nodes\":[");
+    print_con_start(scratch, "workspace", "__i3_scratch", "splith", no_rect, no_rect);
+    printf("\"num\":-1,\"focused\":false,\"window\":null,\"nodes\":[],\"floating_nodes\":[");
+    print_floating_cons(rect, scratchpad, children);
+    printf("],");
+    print_focus(children, scratchpad);
+    printf("],\"floating_nodes\":[],");
+    print_focus(&scratch, 1);
+    printf("],\"floating_nodes\":[],");
+    print_focus(&content, 1);
+    free(children);
+
+    return id;
+}
+
+static void print_tree()
+{
+    unsigned long id = next_id++;
+    unsigned long *children = malloc(sizeof(unsigned long) * (num_outputs + 1));
+    Rect rect = {0, 0, num_outputs * OUTPUT_WIDTH, OUTPUT_HEIGHT};
+
+    print_con_start(id, "root", "root", "splith", rect, no_rect);
+    printf("\"focused\":false,\"window\":null,\"nodes\":[");
+
+    // the focused window lives on the first regular workspace, not in the scratchpad
+    focus_placed = 1;
+    children[num_outputs] = print_scratchpad_output();
+    focus_placed = 0;
+    int i;
+    for (i = 0; i < num_outputs; i++)
+    {
+        printf(",");
+        children[i] = print_output(i);
+    }
+    printf("],\"floating_nodes\":[],");
+    print_focus(children, num_outputs + 1);
+    free(children);
+}
+
+static void print_workspaces()
+{
+    int i, j;
+    for (i = 0; i < num_outputs; i++)
+    {
+        for (j = 0; j < num_workspaces; j++)
+        {
+            int num = i * num_workspaces + j + 1;
+            printf("%s{\"num\":%d,\"name\":\"%d\",\"visible\":%s,\"focused\":%s,\"urgent\":false,",
+                   num > 1 ? "," : "",
+                   num,
+                   num,
+                   j == 0 ? "true" : "false",
+                   num == 1 ? "true" : "false");
+            printf("\"rect\":{\"x\":%d,\"y\":0,\"width\":%d,\"height\":%d},\"output\":\"OUT-%d\"}",
+                   i * OUTPUT_WIDTH, OUTPUT_WIDTH, OUTPUT_HEIGHT, i);
+        }
+    }
+}
+
+static void print_outputs()
+{
+    int i;
+    for (i = 0; i < num_outputs; i++)
+    {
+        printf("%s{\"name\":\"OUT-%d\",\"active\":true,\"primary\":%s,\"current_workspace\":\"%d\",",
+               i ? "," : "",
+               i,
+               i == 0 ? "true" : "false",
+               i * num_workspaces + 1);
+        printf("\"rect\":{\"x\":%d,\"y\":0,\"width\":%d,\"height\":%d}}",
+               i * OUTPUT_WIDTH, OUTPUT_WIDTH, OUTPUT_HEIGHT);
+    }
+}
+
+static void print_recording()
+{
+    printf("{\"t_ns\":0,\"argv\":[\"i3-easyfocus\"]}\n");
+    printf("{\"t_ns\":1000000,\"duration_ns\":0,\"ipc\":\"subscribe\",\"request\":\"[\\\"window\\\",\\\"workspace\\\",\\\"output\\\"]\",\"reply\":{\"success\":true}}\n");
+    printf("{\"t_ns\":2000000,\"duration_ns\":0,\"ipc\":\"get_tree\",\"request\":\"\",\"reply\":");
+    print_tree();
+    printf("}\n");
+
+    // the ids keep counting up, so every reloaded tree has only new windows
+    // and all labels are replaced
+    long long t_ns = 1000000 + RECORDING_ESCAPE_NS;
+    int i;
+    for (i = 0; i < reloads; i++)
+    {
+        printf("{\"t_ns\":%lld,\"event\":\"workspace\",\"change\":\"reload\",\"id\":0,\"urgent\":false,\"name\":null}\n", t_ns);
+        printf("{\"t_ns\":%lld,\"duration_ns\":0,\"ipc\":\"get_tree\",\"request\":\"\",\"reply\":", t_ns + 1000000);
+        print_tree();
+        printf("}\n");
+        t_ns += RECORDING_RELOAD_INTERVAL_NS;
+    }
+
+    // bench/replay-i3 looks the keycode up if it has none for the keysym
+    printf("{\"t_ns\":%lld,\"x_event\":\"key_press\",\"keycode\":%d,\"state\":0,\"keysym\":%ld}\n",
+           t_ns, final_keysym == RECORDING_ESCAPE_KEYSYM ? RECORDING_ESCAPE_KEYCODE : 0, final_keysym);
+}
+
+static int parse_count(const char *arg)
+{
+    char *end;
+    long value = strtol(arg, &end, 10);
+    if (*end != '\0' || value < 0)
+    {
+        fprintf(stderr, "not a valid count: %s\n", arg);
+        print_help();
+        exit(EXIT_FAILURE);
+    }
+
+    return (int) value;
+}
+
+int main(int argc, char *argv[])
+{
+    int o;
+    while ((o = getopt(argc, argv, "ho:w:d:f:t:F:s:PRn:k:")) != -1)
+    {
+        switch (o)
+        {
+        case 'h':
+            print_help();
+            exit(0);
+        case 'o':
+            num_outputs = parse_count(optarg);
+            break;
+        case 'w':
+            num_workspaces = parse_count(optarg);
+            break;
+        case 'd':
+            depth = parse_count(optarg);
+            break;
+        case 'f':
+            fanout = parse_count(optarg);
+            break;
+        case 't':
+            tabbed = parse_count(optarg);
+            break;
+        case 'F':
+            floating = parse_count(optarg);
+            break;
+        case 's':
+            scratchpad = parse_count(optarg);
+            break;
+        case 'P':
+            pile = 1;
+            break;
+        case 'R':
+            recording = 1;
+            break;
+        case 'n':
+            reloads = parse_count(optarg);
+            break;
+        case 'k':
+            final_keysym = strtol(optarg, NULL, 0);
+            break;
+        default:
+            print_help();
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (num_outputs < 1 || num_workspaces < 1 || fanout < 1)
+    {
+        fprintf(stderr, "need at least one output, workspace and split child\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (recording)
+    {
+        print_recording();
+        return 0;
+    }
+
+    printf("{\"tree\":");
+    print_tree();
+    printf(",\"workspaces\":[");
+    print_workspaces();
+    printf("],\"outputs\":[");
+    print_outputs();
+    printf("]}\n");
+
+    return 0;
+}
@@ -0,0 +1,899 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <json-glib/json-glib.h>
+#include <xcb/xcb.h>
+#include <xcb/xtest.h>
+#include <xcb/res.h>
+
+// Plays a session written by i3-easyfocus --record back. It stands in for i3
+// on an IPC socket, answers the requests with the recorded replies and sends
+// the recorded i3 events, and types the recorded keys into an X server such
+// as Xvfb, at the times they happened relative to the first request. When the
+// client is gone it compares when each request arrived with the recording.
+// With -m it also measures the X resources and the memory of the client
+// whenever it asks for the tree again, to find leaks over many relayouts.
+
+#define IPC_MAGIC "i3-ipc"
+#define IPC_MAGIC_SIZE 6
+#define IPC_HEADER_SIZE 14
+#define IPC_EVENT_MASK 0x80000000u
+#define MAX_CLIENTS 8
+#define MAX_REQUEST_PAYLOAD (64 * 1024) // requests are commands and subscriptions
+
+enum
+{
+    MESSAGE_RUN_COMMAND = 0,
+    MESSAGE_GET_WORKSPACES = 1,
+    MESSAGE_SUBSCRIBE = 2,
+    MESSAGE_GET_OUTPUTS = 3,
+    MESSAGE_GET_TREE = 4,
+    MESSAGE_GET_MARKS = 5,
+    MESSAGE_GET_BAR_CONFIG = 6,
+    MESSAGE_GET_VERSION = 7
+};
+
+enum
+{
+    EVENT_WORKSPACE = 0,
+    EVENT_OUTPUT = 1,
+    EVENT_WINDOW = 3
+};
+
+typedef struct request
+{
+    char *type;
+    char *reply;
+    long long t_ns;
+    long long duration_ns; // how long i3 took to reply
+    long long replay_ns;   // when it arrived, -1 if it didn't
+} Request;
+
+typedef struct action
+{
+    long long t_ns;
+    uint32_t event_type; // of i3 events
+    char *payload;       // of i3 events, NULL for key presses
+    xcb_keysym_t keysym;
+    xcb_keycode_t keycode;
+    int done;
+} Action;
+
+typedef struct client
+{
+    int fd;
+    int subscribed;
+    pid_t pid; // 0 if unknown
+} Client;
+
+typedef struct sample
+{
+    long long x_resources; // of all other X clients, -1 if unknown
+    long long rss_kb;      // of the i3 client, -1 if unknown
+} Sample;
+
+static Request *requests = NULL;
+static size_t num_requests = 0;
+static Action *actions = NULL;
+static size_t num_actions = 0;
+
+static Client clients[MAX_CLIENTS];
+static size_t num_clients = 0;
+
+static xcb_connection_t *x_conn = NULL;
+static long long idle_timeout_ms = 5000;
+
+static int measure = 0;
+static size_t num_trees = 0;
+static Sample first_sample = {-1, -1};
+static Sample last_sample = {-1, -1};
+
+static const char skeleton_con[] =
+    "{\"id\":%lld,\"name\":null,\"type\":\"con\",\"border\":\"normal\",\"current_border_width\":2,"
+    "\"layout\":\"splith\",\"orientation\":\"none\",\"percent\":null,"
+    "\"rect\":{\"x\":0,\"y\":0,\"width\":0,\"height\":0},\"window_rect\":{\"x\":0,\"y\":0,\"width\":0,\"height\":0},"
+    "\"deco_rect\":{\"x\":0,\"y\":0,\"width\":0,\"height\":0},\"geometry\":{\"x\":0,\"y\":0,\"width\":0,\"height\":0},"
+    "\"window\":null,\"urgent\":false,\"focused\":false,\"focus\":[],\"nodes\":[],\"floating_nodes\":[],"
+    "\"marks\":[],\"fullscreen_mode\":0,\"floating\":\"auto_off\",\"scratchpad_state\":\"none\",\"sticky\":false}";
+
+static long long monotonic_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void print_help(void)
+{
+    fprintf(stderr, "Usage: replay-i3 [-s <socket>] [-d <display>] [-t <ms>] [-m] <recording>\n");
+    fprintf(stderr, " -h            show this message\n");
+    fprintf(stderr, " -s <socket>   i3 IPC socket to listen on (default: $I3SOCK)\n");
+    fprintf(stderr, " -d <display>  X server to type the recorded keys into (default: $DISPLAY)\n");
+    fprintf(stderr, " -t <ms>       stop after being idle this long (default: %lld)\n", idle_timeout_ms);
+    fprintf(stderr, " -m            report the growth of the X resources and RSS of the client\n");
+}
+
+static char *node_to_string(JsonNode *node)
+{
+    JsonGenerator *generator = json_generator_new();
+    json_generator_set_root(generator, node);
+    char *text = json_generator_to_data(generator, NULL);
+    g_object_unref(generator);
+
+    return text;
+}
+
+static JsonNode *parse_node(const char *text)
+{
+    JsonParser *parser = json_parser_new();
+    JsonNode *node = NULL;
+    if (json_parser_load_from_data(parser, text, -1, NULL))
+    {
+        node = json_node_copy(json_parser_get_root(parser));
+    }
+    g_object_unref(parser);
+
+    return node;
+}
+
+static JsonNode *find_con(JsonNode *con, gint64 id)
+{
+    JsonObject *obj = json_node_get_object(con);
+    if (json_object_get_int_member(obj, "id") == id)
+    {
+        return con;
+    }
+
+    const char *members[] = {"nodes", "floating_nodes"};
+    size_t m;
+    for (m = 0; m < 2; m++)
+    {
+        if (!json_object_has_member(obj, members[m]))
+        {
+            continue;
+        }
+
+        JsonArray *children = json_object_get_array_member(obj, members[m]);
+        guint i;
+        for (i = 0; i < json_array_get_length(children); i++)
+        {
+            JsonNode *found = find_con(json_array_get_element(children, i), id);
+            if (found != NULL)
+            {
+                return found;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * The recording only has the id, urgency and name of the container of an
+ * event, the rest is taken from the tree i3 sent last, or made up for
+ * containers that are not in it.
+ */
+static JsonNode *event_container(JsonNode *tree, gint64 id, gboolean urgent, const char *name)
+{
+    JsonNode *found = tree != NULL ? find_con(tree, id) : NULL;
+    JsonNode *con;
+    if (found != NULL)
+    {
+        con = json_node_copy(found);
+    }
+    else
+    {
+        char skeleton[sizeof(skeleton_con) + 32];
+        snprintf(skeleton, sizeof(skeleton), skeleton_con, (long long) id);
+        con = parse_node(skeleton);
+    }
+
+    JsonObject *obj = json_node_get_object(con);
+    json_object_set_boolean_member(obj, "urgent", urgent);
+    if (name != NULL)
+    {
+        json_object_set_string_member(obj, "name", name);
+    }
+
+    return con;
+}
+
+static void add_event(JsonObject *line, JsonNode *tree)
+{
+    const char *type = json_object_get_string_member(line, "event");
+    const char *change = json_object_get_string_member(line, "change");
+    gint64 id = json_object_get_int_member(line, "id");
+    gboolean urgent = json_object_get_boolean_member(line, "urgent");
+    const char *name = json_object_get_null_member(line, "name") ? NULL : json_object_get_string_member(line, "name");
+
+    JsonBuilder *builder = json_builder_new();
+    json_builder_begin_object(builder);
+    json_builder_set_member_name(builder, "change");
+    json_builder_add_string_value(builder, change);
+
+    uint32_t event_type;
+    if (strcmp(type, "window") == 0)
+    {
+        event_type = EVENT_WINDOW;
+        json_builder_set_member_name(builder, "container");
+        json_builder_add_value(builder, event_container(tree, id, urgent, name));
+    }
+    else if (strcmp(type, "workspace") == 0)
+    {
+        event_type = EVENT_WORKSPACE;
+        json_builder_set_member_name(builder, "current");
+        if (id == 0)
+        {
+            json_builder_add_null_value(builder);
+        }
+        else
+        {
+            json_builder_add_value(builder, event_container(tree, id, urgent, name));
+        }
+        json_builder_set_member_name(builder, "old");
+        json_builder_add_null_value(builder);
+    }
+    else
+    {
+        event_type = EVENT_OUTPUT;
+    }
+    json_builder_end_object(builder);
+
+    JsonNode *root = json_builder_get_root(builder);
+    Action *action = &actions[num_actions++];
+    memset(action, 0, sizeof(Action));
+    action->t_ns = json_object_get_int_member(line, "t_ns");
+    action->event_type = IPC_EVENT_MASK | event_type;
+    action->payload = node_to_string(root);
+
+    json_node_free(root);
+    g_object_unref(builder);
+}
+
+static int load_recording(const char *path)
+{
+    FILE *in = fopen(path, "r");
+    if (in == NULL)
+    {
+        fprintf(stderr, "cannot open recording: %s\n", path);
+        return 1;
+    }
+
+    // every line is a request or an action at most
+    size_t capacity = 0;
+    char *line = NULL;
+    size_t size = 0;
+    while (getline(&line, &size, in) != -1)
+    {
+        capacity++;
+    }
+    rewind(in);
+
+    requests = calloc(capacity, sizeof(Request));
+    actions = calloc(capacity, sizeof(Action));
+
+    JsonNode *tree = NULL;
+    JsonParser *parser = json_parser_new();
+    while (getline(&line, &size, in) != -1)
+    {
+        if (!json_parser_load_from_data(parser, line, -1, NULL))
+        {
+            fprintf(stderr, "skipping malformed line: %s", line);
+            continue;
+        }
+
+        JsonObject *obj = json_node_get_object(json_parser_get_root(parser));
+        if (json_object_has_member(obj, "ipc"))
+        {
+            Request *request = &requests[num_requests++];
+            JsonNode *reply = json_object_get_member(obj, "reply");
+            request->type = g_strdup(json_object_get_string_member(obj, "ipc"));
+            request->reply = node_to_string(reply);
+            request->t_ns = json_object_get_int_member(obj, "t_ns");
+            request->duration_ns = json_object_get_int_member(obj, "duration_ns");
+            request->replay_ns = -1;
+
+            if (strcmp(request->type, "get_tree") == 0)
+            {
+                if (tree != NULL)
+                {
+                    json_node_free(tree);
+                }
+                tree = json_node_copy(reply);
+            }
+        }
+        else if (json_object_has_member(obj, "event"))
+        {
+            add_event(obj, tree);
+        }
+        else if (json_object_has_member(obj, "x_event") &&
+                 strcmp(json_object_get_string_member(obj, "x_event"), "key_press") == 0)
+        {
+            Action *action = &actions[num_actions++];
+            memset(action, 0, sizeof(Action));
+            action->t_ns = json_object_get_int_member(obj, "t_ns");
+            action->keysym = json_object_get_int_member(obj, "keysym");
+            action->keycode = json_object_get_int_member(obj, "keycode");
+        }
+        // configure notify and focus events concern windows that only exist
+        // on the recorded desktop, so they are not played back
+    }
+
+    if (tree != NULL)
+    {
+        json_node_free(tree);
+    }
+    g_object_unref(parser);
+    free(line);
+    fclose(in);
+
+    if (num_requests == 0)
+    {
+        fprintf(stderr, "no i3 requests in recording: %s\n", path);
+        return 1;
+    }
+
+    return 0;
+}
+
+static void free_recording()
+{
+    size_t i;
+    for (i = 0; i < num_requests; i++)
+    {
+        g_free(requests[i].type);
+        g_free(requests[i].reply);
+    }
+    for (i = 0; i < num_actions; i++)
+    {
+        g_free(actions[i].payload);
+    }
+
+    free(requests);
+    free(actions);
+}
+
+static int read_full(int fd, void *buf, size_t count)
+{
+    size_t done = 0;
+    while (done < count)
+    {
+        ssize_t n = read(fd, (char *) buf + done, count - done);
+        if (n <= 0)
+        {
+            return 1;
+        }
+        done += n;
+    }
+
+    return 0;
+}
+
+static int write_full(int fd, const void *buf, size_t count)
+{
+    size_t done = 0;
+    while (done < count)
+    {
+        ssize_t n = write(fd, (const char *) buf + done, count - done);
+        if (n <= 0)
+        {
+            return 1;
+        }
+        done += n;
+    }
+
+    return 0;
+}
+
+static int send_message(int fd, uint32_t type, const char *payload)
+{
+    char header[IPC_HEADER_SIZE];
+    uint32_t length = strlen(payload);
+    memcpy(header, IPC_MAGIC, IPC_MAGIC_SIZE);
+    memcpy(header + IPC_MAGIC_SIZE, &length, sizeof(length));
+    memcpy(header + IPC_MAGIC_SIZE + sizeof(length), &type, sizeof(type));
+
+    return write_full(fd, header, IPC_HEADER_SIZE) || write_full(fd, payload, length);
+}
+
+// requests are answered in the order they were recorded in, per type
+static Request *next_request(const char *type)
+{
+    size_t i;
+    for (i = 0; i < num_requests; i++)
+    {
+        if (requests[i].replay_ns < 0 && strcmp(requests[i].type, type) == 0)
+        {
+            return &requests[i];
+        }
+    }
+
+    return NULL;
+}
+
+static const char *last_reply(const char *type, const char *fallback)
+{
+    size_t i;
+    for (i = num_requests; i > 0; i--)
+    {
+        if (strcmp(requests[i - 1].type, type) == 0)
+        {
+            return requests[i - 1].reply;
+        }
+    }
+
+    return fallback;
+}
+
+static const char *answer(Client *client, uint32_t type, long long now)
+{
+    const char *name;
+    const char *fallback;
+    switch (type)
+    {
+    case MESSAGE_RUN_COMMAND:
+        name = "command";
+        fallback = "[{\"success\":true}]";
+        break;
+    case MESSAGE_SUBSCRIBE:
+        name = "subscribe";
+        fallback = "{\"success\":true}";
+        client->subscribed = 1;
+        break;
+    case MESSAGE_GET_TREE:
+        name = "get_tree";
+        fallback = NULL;
+        break;
+    case MESSAGE_GET_VERSION:
+        return "{\"major\":4,\"minor\":0,\"patch\":0,\"human_readable\":\"replay-i3\",\"loaded_config_file_name\":\"\"}";
+    case MESSAGE_GET_BAR_CONFIG:
+    case MESSAGE_GET_WORKSPACES:
+    case MESSAGE_GET_OUTPUTS:
+    case MESSAGE_GET_MARKS:
+    default:
+        return "[]";
+    }
+
+    Request *request = next_request(name);
+    if (request == NULL)
+    {
+        return last_reply(name, fallback != NULL ? fallback : "{}");
+    }
+
+    request->replay_ns = now;
+    return request->reply;
+}
+
+static long long count_x_resources()
+{
+    if (x_conn == NULL)
+    {
+        return -1;
+    }
+
+    xcb_res_query_clients_reply_t *reply = xcb_res_query_clients_reply(x_conn, xcb_res_query_clients(x_conn), NULL);
+    if (reply == NULL)
+    {
+        return -1;
+    }
+
+    // the stand-in's own connection doesn't change
+    uint32_t own_base = xcb_get_setup(x_conn)->resource_id_base;
+    long long total = 0;
+    xcb_res_client_iterator_t client;
+    for (client = xcb_res_query_clients_clients_iterator(reply); client.rem > 0; xcb_res_client_next(&client))
+    {
+        if (client.data->resource_base == own_base)
+        {
+            continue;
+        }
+
+        xcb_res_query_client_resources_reply_t *resources = xcb_res_query_client_resources_reply(
+            x_conn, xcb_res_query_client_resources(x_conn, client.data->resource_base), NULL);
+        if (resources == NULL)
+        {
+            continue;
+        }
+
+        xcb_res_type_iterator_t type;
+        for (type = xcb_res_query_client_resources_types_iterator(resources); type.rem > 0; xcb_res_type_next(&type))
+        {
+            total += type.data->count;
+        }
+        free(resources);
+    }
+
+    free(reply);
+    return total;
+}
+
+static long long read_rss_kb(pid_t pid)
+{
+    if (pid == 0)
+    {
+        return -1;
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%ld/status", (long) pid);
+    FILE *status = fopen(path, "r");
+    if (status == NULL)
+    {
+        return -1;
+    }
+
+    long long rss_kb = -1;
+    char line[256];
+    while (fgets(line, sizeof(line), status) != NULL)
+    {
+        if (sscanf(line, "VmRSS: %lld", &rss_kb) == 1)
+        {
+            break;
+        }
+    }
+
+    fclose(status);
+    return rss_kb;
+}
+
+/*
+ * The first tree is fetched before any label exists. Every later one is
+ * fetched while the labels of the previous tree are shown, so the state of
+ * the client is the same each time and anything that grows leaks.
+ */
+static void take_sample(Client *client)
+{
+    num_trees++;
+    if (!measure || num_trees < 2)
+    {
+        return;
+    }
+
+    last_sample.x_resources = count_x_resources();
+    last_sample.rss_kb = read_rss_kb(client->pid);
+    if (num_trees == 2)
+    {
+        first_sample = last_sample;
+    }
+}
+
+static int handle_message(Client *client, long long *base_ns)
+{
+    char header[IPC_HEADER_SIZE];
+    if (read_full(client->fd, header, IPC_HEADER_SIZE) || memcmp(header, IPC_MAGIC, IPC_MAGIC_SIZE) != 0)
+    {
+        return 1;
+    }
+
+    uint32_t length, type;
+    memcpy(&length, header + IPC_MAGIC_SIZE, sizeof(length));
+    memcpy(&type, header + IPC_MAGIC_SIZE + sizeof(length), sizeof(type));
+
+    if (length > MAX_REQUEST_PAYLOAD)
+    {
+        fprintf(stderr, "request too large (type: %u, length: %u)\n", type, length);
+        return 1;
+    }
+
+    char *payload = malloc(length + 1);
+    if (payload == NULL || read_full(client->fd, payload, length))
+    {
+        free(payload);
+        return 1;
+    }
+    free(payload);
+
+    if (type == MESSAGE_GET_TREE)
+    {
+        take_sample(client);
+    }
+
+    long long now = monotonic_ns();
+    if (*base_ns < 0)
+    {
+        *base_ns = now;
+    }
+
+    return send_message(client->fd, type, answer(client, type, now - *base_ns));
+}
+
+static xcb_keycode_t keycode_for(xcb_keysym_t keysym, xcb_keycode_t recorded)
+{
+    const xcb_setup_t *setup = xcb_get_setup(x_conn);
+    int count = setup->max_keycode - setup->min_keycode + 1;
+    xcb_get_keyboard_mapping_reply_t *reply = xcb_get_keyboard_mapping_reply(
+        x_conn, xcb_get_keyboard_mapping(x_conn, setup->min_keycode, count), NULL);
+    if (reply == NULL)
+    {
+        return recorded;
+    }
+
+    // the recorded keyboard may be laid out differently
+    xcb_keysym_t *syms = xcb_get_keyboard_mapping_keysyms(reply);
+    xcb_keycode_t keycode = recorded;
+    int i;
+    for (i = 0; i < count; i++)
+    {
+        if (syms[i * reply->keysyms_per_keycode] == keysym)
+        {
+            keycode = setup->min_keycode + i;
+            break;
+        }
+    }
+
+    free(reply);
+    return keycode;
+}
+
+static int perform(Action *action)
+{
+    if (action->payload == NULL)
+    {
+        if (x_conn == NULL)
+        {
+            fprintf(stderr, "no display, skipping key press (keysym: %u)\n", action->keysym);
+            return 1;
+        }
+
+        xcb_keycode_t keycode = keycode_for(action->keysym, action->keycode);
+        xcb_test_fake_input(x_conn, XCB_KEY_PRESS, keycode, XCB_CURRENT_TIME, XCB_NONE, 0, 0, 0);
+        xcb_test_fake_input(x_conn, XCB_KEY_RELEASE, keycode, XCB_CURRENT_TIME, XCB_NONE, 0, 0, 0);
+        xcb_flush(x_conn);
+        return 1;
+    }
+
+    // i3 events wait for a subscription
+    size_t i;
+    for (i = 0; i < num_clients; i++)
+    {
+        if (clients[i].subscribed)
+        {
+            send_message(clients[i].fd, action->event_type, action->payload);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static long long perform_due_actions(long long base_ns, long long record_base_ns)
+{
+    long long next_ns = -1;
+    long long elapsed = monotonic_ns() - base_ns;
+    size_t i;
+    for (i = 0; i < num_actions; i++)
+    {
+        Action *action = &actions[i];
+        if (action->done)
+        {
+            continue;
+        }
+
+        long long due = action->t_ns - record_base_ns;
+        if (due <= elapsed)
+        {
+            action->done = perform(action);
+            if (!action->done)
+            {
+                // waits for a subscription, so check again right away
+                next_ns = elapsed;
+            }
+        }
+        else if (next_ns < 0 || due < next_ns)
+        {
+            next_ns = due;
+        }
+    }
+
+    return next_ns < 0 ? -1 : next_ns - elapsed;
+}
+
+static void print_report(long long record_base_ns)
+{
+    printf("%-10s %12s %12s %12s %12s\n", "request", "recorded ms", "replay ms", "diff ms", "i3 reply ms");
+
+    long long recorded_end = 0;
+    long long replay_end = 0;
+    size_t i;
+    for (i = 0; i < num_requests; i++)
+    {
+        Request *request = &requests[i];
+        double recorded = (request->t_ns - record_base_ns) / 1e6;
+        if (request->replay_ns < 0)
+        {
+            printf("%-10s %12.3f %12s %12s %12.3f\n", request->type, recorded, "-", "-", request->duration_ns / 1e6);
+            continue;
+        }
+
+        double replayed = request->replay_ns / 1e6;
+        printf("%-10s %12.3f %12.3f %12.3f %12.3f\n", request->type, recorded, replayed, replayed - recorded, request->duration_ns / 1e6);
+        recorded_end = request->t_ns - record_base_ns;
+        replay_end = request->replay_ns;
+    }
+
+    printf("last answered request: recorded %.3f ms, replayed %.3f ms\n", recorded_end / 1e6, replay_end / 1e6);
+
+    if (measure && num_trees >= 2)
+    {
+        printf("after %lu trees: X resources %lld -> %lld, client RSS %lld -> %lld kB\n",
+               (unsigned long) num_trees,
+               first_sample.x_resources,
+               last_sample.x_resources,
+               first_sample.rss_kb,
+               last_sample.rss_kb);
+    }
+}
+
+static int listen_on(const char *path)
+{
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "socket path too long: %s\n", path);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(fd, MAX_CLIENTS) != 0)
+    {
+        fprintf(stderr, "cannot listen on %s\n", path);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+
+    return fd;
+}
+
+static void remove_client(size_t index)
+{
+    close(clients[index].fd);
+    clients[index] = clients[--num_clients];
+}
+
+int main(int argc, char *argv[])
+{
+    const char *socket_path = getenv("I3SOCK");
+    const char *display = NULL;
+    int o;
+    while ((o = getopt(argc, argv, "hs:d:t:m")) != -1)
+    {
+        switch (o)
+        {
+        case 'h':
+            print_help();
+            exit(0);
+        case 's':
+            socket_path = optarg;
+            break;
+        case 'd':
+            display = optarg;
+            break;
+        case 't':
+            idle_timeout_ms = atoll(optarg);
+            break;
+        case 'm':
+            measure = 1;
+            break;
+        default:
+            print_help();
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (optind >= argc || socket_path == NULL)
+    {
+        print_help();
+        exit(EXIT_FAILURE);
+    }
+
+    if (load_recording(argv[optind]))
+    {
+        free_recording();
+        return 1;
+    }
+
+    x_conn = xcb_connect(display, NULL);
+    if (xcb_connection_has_error(x_conn))
+    {
+        fprintf(stderr, "cannot connect to X, keys are not played back\n");
+        xcb_disconnect(x_conn);
+        x_conn = NULL;
+    }
+
+    int listener = listen_on(socket_path);
+    if (listener < 0)
+    {
+        free_recording();
+        return 1;
+    }
+
+    long long record_base_ns = requests[0].t_ns;
+    long long base_ns = -1;
+    long long last_activity = monotonic_ns();
+    int connected = 0;
+    while (!connected || num_clients > 0)
+    {
+        long long wait_ns = base_ns < 0 ? -1 : perform_due_actions(base_ns, record_base_ns);
+        long long idle_ns = last_activity + idle_timeout_ms * 1000000LL - monotonic_ns();
+        if (idle_ns <= 0)
+        {
+            fprintf(stderr, "idle for %lld ms, stopping\n", idle_timeout_ms);
+            break;
+        }
+        if (wait_ns < 0 || wait_ns > idle_ns)
+        {
+            wait_ns = idle_ns;
+        }
+
+        struct pollfd fds[MAX_CLIENTS + 1];
+        fds[0].fd = listener;
+        fds[0].events = POLLIN;
+        size_t i;
+        for (i = 0; i < num_clients; i++)
+        {
+            fds[i + 1].fd = clients[i].fd;
+            fds[i + 1].events = POLLIN;
+        }
+
+        if (poll(fds, num_clients + 1, (int) (wait_ns / 1000000) + 1) <= 0)
+        {
+            continue;
+        }
+        last_activity = monotonic_ns();
+
+        // clients are handled last to first, as removing one moves the last
+        for (i = num_clients; i > 0; i--)
+        {
+            if (fds[i].revents != 0 && handle_message(&clients[i - 1], &base_ns))
+            {
+                remove_client(i - 1);
+            }
+        }
+
+        if ((fds[0].revents & POLLIN) && num_clients < MAX_CLIENTS)
+        {
+            int fd = accept(listener, NULL, NULL);
+            if (fd >= 0)
+            {
+                struct ucred cred;
+                socklen_t cred_size = sizeof(cred);
+                clients[num_clients].fd = fd;
+                clients[num_clients].subscribed = 0;
+                clients[num_clients].pid = getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_size) == 0 ? cred.pid : 0;
+                num_clients++;
+                connected = 1;
+            }
+        }
+    }
+
+    print_report(record_base_ns);
+
+    while (num_clients > 0)
+    {
+        remove_client(0);
+    }
+    close(listener);
+    unlink(socket_path);
+    if (x_conn != NULL)
+    {
+        xcb_disconnect(x_conn);
+    }
+    free_recording();
+
+    return 0;
+}
@@ -0,0 +1,67 @@
+#!/bin/sh
+# Plays a recording of i3-easyfocus --record back against bench/replay-i3 on
+# an Xvfb display and reports how the timings compare with the original:
+#
+#   bench/replay.sh <recording> [i3-easyfocus options]
+#
+# The options should be the ones the session was recorded with, they are in
+# the first line of the recording. I3SOCK and REPLAY_DISPLAY select the
+# socket and display to use, REPLAY_CLIENT another build of i3-easyfocus and
+# REPLAY_OPTIONS additional options of bench/replay-i3. Exits with the status
+# of the client.
+
+if [ $# -lt 1 ]; then
+    echo "Usage: bench/replay.sh <recording> [i3-easyfocus options]" >&2
+    exit 1
+fi
+
+recording=$1
+shift
+
+I3SOCK=${I3SOCK:-/tmp/i3-easyfocus-replay.$$.sock}
+export I3SOCK
+display=${REPLAY_DISPLAY:-:99}
+client_path=${REPLAY_CLIENT:-./i3-easyfocus}
+
+Xvfb "$display" -screen 0 1920x1080x24 -nolisten tcp >/dev/null 2>&1 &
+xvfb=$!
+trap 'kill $xvfb 2>/dev/null' EXIT
+
+tries=0
+while [ ! -S "/tmp/.X11-unix/X${display#:}" ]; do
+    tries=$((tries + 1))
+    if [ $tries -gt 50 ] || ! kill -0 $xvfb 2>/dev/null; then
+        echo "cannot start Xvfb on $display" >&2
+        exit 1
+    fi
+    sleep 0.1
+done
+
+bench/replay-i3 -s "$I3SOCK" -d "$display" $REPLAY_OPTIONS "$recording" &
+stand_in=$!
+
+tries=0
+while [ ! -S "$I3SOCK" ]; do
+    tries=$((tries + 1))
+    if [ $tries -gt 50 ] || ! kill -0 $stand_in 2>/dev/null; then
+        echo "cannot start bench/replay-i3 on $I3SOCK" >&2
+        exit 1
+    fi
+    sleep 0.1
+done
+
+DISPLAY=$display "$client_path" "$@" &
+client=$!
+
+# the stand-in reports once the client is done or stopped pressing keys, the
+# client gets a moment to write its trace and leak report before it is stopped
+wait $stand_in
+tries=0
+while kill -0 $client 2>/dev/null && [ $tries -lt 50 ]; do
+    tries=$((tries + 1))
+    sleep 0.1
+done
+kill $client 2>/dev/null
+wait $client 2>/dev/null
+status=$?
+exit $status
@@ -0,0 +1,51 @@
+#!/bin/sh
+# Replaces all 36 labels of a generated session many times within a single
+# client built with LeakSanitizer (bench/i3-easyfocus-lsan), and fails if a
+# leak is reported or if the X resources or the RSS of the client grew
+# between the first and the last relayout:
+#
+#   bench/soak.sh [iterations]
+#
+# SOAK_MAX_X_RESOURCE_GROWTH and SOAK_MAX_RSS_GROWTH_KB set how much growth
+# is tolerated.
+
+iterations=${1:-2000}
+max_x_growth=${SOAK_MAX_X_RESOURCE_GROWTH:-0}
+max_rss_growth_kb=${SOAK_MAX_RSS_GROWTH_KB:-1024}
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+XDG_CACHE_HOME=$dir/cache
+export XDG_CACHE_HOME
+
+bench/gen-tree -R -n "$iterations" -o 2 -w 1 -d 1 -f 16 -t 0 -F 2 -s 0 > "$dir/session.jsonl" || exit 1
+REPLAY_CLIENT=bench/i3-easyfocus-lsan REPLAY_OPTIONS=-m \
+    bench/replay.sh "$dir/session.jsonl" --all > "$dir/report.txt" 2> "$dir/stderr.txt"
+status=$?
+
+failed=0
+if [ $status -ne 0 ] || grep -q LeakSanitizer "$dir/stderr.txt"; then
+    cat "$dir/stderr.txt" >&2
+    echo "the client failed or leaked (exit status: $status)" >&2
+    failed=1
+fi
+
+growth=$(sed -n 's/^after \([0-9]*\) trees: X resources \([0-9]*\) -> \([0-9]*\), client RSS \([0-9]*\) -> \([0-9]*\) kB$/\1 \2 \3 \4 \5/p' "$dir/report.txt")
+if [ -z "$growth" ]; then
+    echo "the labels were not replaced or could not be measured" >&2
+    exit 1
+fi
+
+set -- $growth
+echo "after $1 trees: X resources $2 -> $3, client RSS $4 -> $5 kB"
+if [ $(($3 - $2)) -gt "$max_x_growth" ]; then
+    echo "X resources grew by $(($3 - $2))" >&2
+    failed=1
+fi
+if [ $(($5 - $4)) -gt "$max_rss_growth_kb" ]; then
+    echo "client RSS grew by $(($5 - $4)) kB" >&2
+    failed=1
+fi
+
+exit $failed
@@ -0,0 +1,271 @@
+#include "cache.h"
+#include "util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Keeps what a launch would otherwise query from the X server before it can
+ * draw: the font that could be opened, its metrics and the keyboard mapping.
+ * There is one file per display and font pattern. The keyboard mapping is
+ * checked against its fingerprint when loading, and against the server by
+ * the caller once the labels are shown.
+ */
+
+#define CACHE_MAGIC 0x45334943 // "CI3E"
+#define CACHE_VERSION 1
+
+typedef struct cache_header
+{
+    uint32_t magic;
+    uint32_t version;
+    char display[CACHE_MAX_NAME];
+    char font_pattern[CACHE_MAX_NAME];
+    char font_name[CACHE_MAX_NAME];
+    FontMetrics metrics;
+    uint32_t keymap_fingerprint;
+    uint32_t num_keysyms;
+    xcb_keycode_t min_keycode;
+    xcb_keycode_t max_keycode;
+    uint8_t keysyms_per_keycode;
+} CacheHeader;
+
+// FNV-1a
+static uint32_t hash_bytes(uint32_t hash, const void *data, size_t size)
+{
+    const unsigned char *bytes = data;
+    size_t i;
+    for (i = 0; i < size; i++)
+    {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+uint32_t cache_fingerprint(const xcb_keysym_t *keysyms, size_t count)
+{
+    return hash_bytes(2166136261u, keysyms, count * sizeof(xcb_keysym_t));
+}
+
+static int cache_dir(char *path, size_t size)
+{
+    const char *base = getenv("XDG_CACHE_HOME");
+    int written;
+    if (base != NULL && base[0] == '/')
+    {
+        written = snprintf(path, size, "%s/i3-easyfocus", base);
+    }
+    else
+    {
+        const char *home = getenv("HOME");
+        if (home == NULL)
+        {
+            return 1;
+        }
+        written = snprintf(path, size, "%s/.cache/i3-easyfocus", home);
+    }
+
+    return written < 0 || (size_t) written >= size;
+}
+
+static int cache_path(const char *display, const char *font_pattern, char *path, size_t size)
+{
+    char dir[CACHE_MAX_PATH];
+    if (cache_dir(dir, sizeof(dir)))
+    {
+        return 1;
+    }
+
+    uint32_t hash = hash_bytes(2166136261u, display, strlen(display) + 1);
+    hash = hash_bytes(hash, font_pattern, strlen(font_pattern) + 1);
+    int written = snprintf(path, size, "%s/x-%08x", dir, hash);
+
+    return written < 0 || (size_t) written >= size;
+}
+
+// like mkdir -p, as neither the cache home nor ~/.cache have to exist yet
+static int make_dirs(char *path)
+{
+    char *p;
+    for (p = path + 1; *p != '\0'; p++)
+    {
+        if (*p != '/')
+        {
+            continue;
+        }
+
+        *p = '\0';
+        int failed = (mkdir(path, 0700) != 0 && errno != EEXIST);
+        *p = '/';
+        if (failed)
+        {
+            return 1;
+        }
+    }
+
+    return mkdir(path, 0700) != 0 && errno != EEXIST;
+}
+
+int cache_file_path(const char *name, int create_dir, char *path, size_t size)
+{
+    char dir[CACHE_MAX_PATH];
+    if (cache_dir(dir, sizeof(dir)) || (create_dir && make_dirs(dir)))
+    {
+        return 1;
+    }
+
+    int written = snprintf(path, size, "%s/%s", dir, name);
+    return written < 0 || (size_t) written >= size;
+}
+
+static int key_fits(const char *display, const char *font_pattern)
+{
+    return strlen(display) < CACHE_MAX_NAME && strlen(font_pattern) < CACHE_MAX_NAME;
+}
+
+int cache_load(const char *display, const char *font_pattern, Cache *cache)
+{
+    memset(cache, 0, sizeof(Cache));
+
+    char path[CACHE_MAX_PATH];
+    if (!key_fits(display, font_pattern) || cache_path(display, font_pattern, path, sizeof(path)))
+    {
+        return 1;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        LOG("no cache at %s\n", path);
+        return 1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(CacheHeader))
+    {
+        close(fd);
+        return 1;
+    }
+
+    size_t size = (size_t) st.st_size;
+    void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        LOG("cannot map cache %s\n", path);
+        return 1;
+    }
+
+    const CacheHeader *header = data;
+    const xcb_keysym_t *keysyms = (const xcb_keysym_t *) (header + 1);
+    size_t expected = header->min_keycode <= header->max_keycode
+                          ? (size_t) (header->max_keycode - header->min_keycode + 1) * header->keysyms_per_keycode
+                          : 0;
+
+    int valid = header->magic == CACHE_MAGIC &&
+                header->version == CACHE_VERSION &&
+                strncmp(header->display, display, CACHE_MAX_NAME) == 0 &&
+                strncmp(header->font_pattern, font_pattern, CACHE_MAX_NAME) == 0 &&
+                memchr(header->font_name, '\0', CACHE_MAX_NAME) != NULL &&
+                header->num_keysyms == expected &&
+                size == sizeof(CacheHeader) + expected * sizeof(xcb_keysym_t) &&
+                cache_fingerprint(keysyms, expected) == header->keymap_fingerprint;
+
+    if (valid && expected > 0)
+    {
+        cache->keysyms = malloc(expected * sizeof(xcb_keysym_t));
+        valid = (cache->keysyms != NULL);
+    }
+
+    if (valid)
+    {
+        memcpy(cache->font_name, header->font_name, CACHE_MAX_NAME);
+        cache->metrics = header->metrics;
+        cache->min_keycode = header->min_keycode;
+        cache->max_keycode = header->max_keycode;
+        cache->keysyms_per_keycode = header->keysyms_per_keycode;
+        if (expected > 0)
+        {
+            memcpy(cache->keysyms, keysyms, expected * sizeof(xcb_keysym_t));
+        }
+    }
+    else
+    {
+        LOG("ignoring stale cache %s\n", path);
+    }
+
+    munmap(data, size);
+    return !valid;
+}
+
+int cache_store(const char *display, const char *font_pattern, const Cache *cache)
+{
+    char dir[CACHE_MAX_PATH];
+    char path[CACHE_MAX_PATH];
+    char tmp[CACHE_MAX_PATH + 8];
+    if (!key_fits(display, font_pattern) ||
+        cache_dir(dir, sizeof(dir)) ||
+        cache_path(display, font_pattern, path, sizeof(path)))
+    {
+        return 1;
+    }
+
+    if (make_dirs(dir))
+    {
+        LOG("cannot create cache directory %s\n", dir);
+        return 1;
+    }
+
+    size_t count = cache->min_keycode <= cache->max_keycode && cache->keysyms != NULL
+                       ? (size_t) (cache->max_keycode - cache->min_keycode + 1) * cache->keysyms_per_keycode
+                       : 0;
+
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = CACHE_MAGIC;
+    header.version = CACHE_VERSION;
+    strncpy(header.display, display, CACHE_MAX_NAME - 1);
+    strncpy(header.font_pattern, font_pattern, CACHE_MAX_NAME - 1);
+    strncpy(header.font_name, cache->font_name, CACHE_MAX_NAME - 1);
+    header.metrics = cache->metrics;
+    header.keymap_fingerprint = cache_fingerprint(cache->keysyms, count);
+    header.num_keysyms = count;
+    header.min_keycode = count > 0 ? cache->min_keycode : 1;
+    header.max_keycode = count > 0 ? cache->max_keycode : 0;
+    header.keysyms_per_keycode = count > 0 ? cache->keysyms_per_keycode : 0;
+
+    // written next to the cache and renamed, so readers never see half a file
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int) getpid());
+    FILE *out = fopen(tmp, "wb");
+    if (out == NULL)
+    {
+        LOG("cannot write cache %s\n", tmp);
+        return 1;
+    }
+
+    int failed = fwrite(&header, sizeof(header), 1, out) != 1 ||
+                 (count > 0 && fwrite(cache->keysyms, sizeof(xcb_keysym_t), count, out) != count);
+    failed = (fclose(out) != 0) || failed;
+    if (failed || rename(tmp, path) != 0)
+    {
+        LOG("cannot write cache %s\n", path);
+        unlink(tmp);
+        return 1;
+    }
+
+    LOG("stored cache %s\n", path);
+    return 0;
+}
+
+void cache_free(Cache *cache)
+{
+    free(cache->keysyms);
+    cache->keysyms = NULL;
+}
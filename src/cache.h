@@ -0,0 +1,34 @@
+#ifndef I3_EASYFOCUS_CACHE
+#define I3_EASYFOCUS_CACHE
+
+#include <stdint.h>
+#include <xcb/xcb.h>
+
+#define CACHE_MAX_NAME 256
+#define CACHE_MAX_PATH 4096
+
+typedef struct font_metrics
+{
+    int16_t ascent;
+    int16_t descent;
+    int16_t max_width;
+    uint16_t widths[256]; // of the characters of single byte strings
+} FontMetrics;
+
+typedef struct cache
+{
+    char font_name[CACHE_MAX_NAME]; // the pattern that could be opened
+    FontMetrics metrics;
+    xcb_keycode_t min_keycode;
+    xcb_keycode_t max_keycode;
+    uint8_t keysyms_per_keycode;
+    xcb_keysym_t *keysyms;
+} Cache;
+
+int cache_load(const char *display, const char *font_pattern, Cache *cache);
+int cache_store(const char *display, const char *font_pattern, const Cache *cache);
+uint32_t cache_fingerprint(const xcb_keysym_t *keysyms, size_t count);
+void cache_free(Cache *cache);
+int cache_file_path(const char *name, int create_dir, char *path, size_t size);
+
+#endif
@@ -2,9 +2,60 @@
 #define I3_EASYFOCUS_CONFIG
 
 #define EXIT_KEYSYM XK_Escape
-#define LABEL_KEYSYMS_AVY { XK_a, XK_s, XK_d, XK_f, XK_g, XK_h, XK_j, XK_k, XK_l, XK_q, XK_w, XK_e, XK_r, XK_t, XK_y, XK_u, XK_i, XK_o, XK_p, XK_z, XK_x, XK_c, XK_v, XK_b, XK_n, XK_m, XK_1, XK_2, XK_3, XK_4, XK_5, XK_6, XK_7, XK_8, XK_9, XK_0 }
-#define LABEL_KEYSYMS_COLEMAK { XK_a, XK_r, XK_s, XK_t, XK_d, XK_h, XK_n, XK_e, XK_i, XK_o, XK_q, XK_w, XK_f, XK_p, XK_g, XK_j, XK_l, XK_u, XK_y, XK_z, XK_x, XK_c, XK_v, XK_b, XK_n, XK_m, XK_1, XK_2, XK_3, XK_4, XK_5, XK_6, XK_7, XK_8, XK_9, XK_0 }
-#define LABEL_KEYSYMS_ALPHA { XK_a, XK_b, XK_c, XK_d, XK_e, XK_f, XK_g, XK_h, XK_i, XK_j, XK_k, XK_l, XK_m, XK_n, XK_o, XK_p, XK_q, XK_r, XK_s, XK_t, XK_u, XK_v, XK_w, XK_x, XK_y, XK_z, XK_1, XK_2, XK_3, XK_4, XK_5, XK_6, XK_7, XK_8, XK_9, XK_0 }
+// the label keys, each as the name of its keysym without the XK_ prefix,
+// which map.c expands into the keysyms and their names
+#define LABEL_KEYS_AVY(KEY) KEY(a) KEY(s) KEY(d) KEY(f) KEY(g) KEY(h) KEY(j) KEY(k) KEY(l) KEY(q) KEY(w) KEY(e) KEY(r) KEY(t) KEY(y) KEY(u) KEY(i) KEY(o) KEY(p) KEY(z) KEY(x) KEY(c) KEY(v) KEY(b) KEY(n) KEY(m) KEY(1) KEY(2) KEY(3) KEY(4) KEY(5) KEY(6) KEY(7) KEY(8) KEY(9) KEY(0)
+#define LABEL_KEYS_COLEMAK(KEY) KEY(a) KEY(r) KEY(s) KEY(t) KEY(d) KEY(h) KEY(n) KEY(e) KEY(i) KEY(o) KEY(q) KEY(w) KEY(f) KEY(p) KEY(g) KEY(j) KEY(l) KEY(u) KEY(y) KEY(z) KEY(x) KEY(c) KEY(v) KEY(b) KEY(n) KEY(m) KEY(1) KEY(2) KEY(3) KEY(4) KEY(5) KEY(6) KEY(7) KEY(8) KEY(9) KEY(0)
+#define LABEL_KEYS_ALPHA(KEY) KEY(a) KEY(b) KEY(c) KEY(d) KEY(e) KEY(f) KEY(g) KEY(h) KEY(i) KEY(j) KEY(k) KEY(l) KEY(m) KEY(n) KEY(o) KEY(p) KEY(q) KEY(r) KEY(s) KEY(t) KEY(u) KEY(v) KEY(w) KEY(x) KEY(y) KEY(z) KEY(1) KEY(2) KEY(3) KEY(4) KEY(5) KEY(6) KEY(7) KEY(8) KEY(9) KEY(0)
+
+#define FILTER_CHOOSE_KEYSYM XK_Tab
+#define FILTER_ACCEPT_KEYSYM XK_Return
+#define FILTER_DELETE_KEYSYM XK_BackSpace
+
+// characters of the labels of windows on hidden workspaces, which also
+// name the workspace and the window
+#define HIDDEN_CAPTION_LENGTH 32
+
+#define KEYBOARD_GRAB_ATTEMPTS 100
+#define KEYBOARD_GRAB_RETRY_MS 5
+
+// --all walks the visible workspaces on up to this many threads, once they
+// hold at least WALK_PARALLEL_MIN_CONS containers
+#define WALK_MAX_THREADS 4
+#define WALK_PARALLEL_MIN_CONS 2048
+
+// the strings of the windows found by a walk are copied into blocks of this
+// size, one per walking thread
+#define WINDOW_STRINGS_BLOCK_SIZE 4096
+
+// windows whose keys --stable remembers, the most recently labelled ones
+#define STABLE_MAX_ENTRIES 256
+
+// a keysym can be on several keys, each of which is grabbed with and without
+// numlock and capslock
+#define MAX_KEYCODES_PER_KEYSYM 4
+#define LOCK_MODIFIER_COMBINATIONS 4
+#define KEY_GRAB_ROUND_TRIPS (MAX_KEYCODES_PER_KEYSYM * LOCK_MODIFIER_COMBINATIONS)
+
+// synchronous X round trips and i3 IPC messages each phase of --trace may
+// take, in the order of TracePhase: {x round trips, x round trips when served
+// from the cache, x round trips per label or key grab, ipc messages}. --trace
+// reports phases that exceed them, --trace-strict also fails.
+#define TRACE_BUDGETS {                                         \
+        {0, 0, 0, 0}, /* ipc_init: the handshake isn't counted */ \
+        {0, 0, 0, 1}, /* get_tree */                            \
+        {0, 0, 0, 0}, /* visibility */                          \
+        {0, 0, 0, 0}, /* placement */                           \
+        {7, 5, 0, 0}, /* xcb_init: xkb extension, xkb map and state, colors, font, font info, gc, root events; the cache skips the font and its info */ \
+        {KEY_GRAB_ROUND_TRIPS, KEY_GRAB_ROUND_TRIPS, KEY_GRAB_ROUND_TRIPS, 0}, /* key_grabs: exit key and one per label */ \
+        {0, 0, 4, 0}, /* labels: window, configure, map, text */ \
+        {0, 0, 4, 0}, /* first_expose */                        \
+        {1, 1, 0, 0}, /* key_press: keymap reload */            \
+        {0, 0, 0, 1}  /* focus */                               \
+    }
+
+#define CONFIGURE_NOTIFY_QUIET_MS 50
+#define CONFIGURE_NOTIFY_MAX_DELAY_MS 250
 
 #define XCB_DEFAULT_FONT_NAME "-Misc-Fixed-Bold-R-Normal--18-120-100-100-C-90-ISO10646-1"
 
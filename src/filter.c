@@ -0,0 +1,255 @@
+#include "filter.h"
+#include "util.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Narrows the windows down to the ones whose title, class or instance
+ * contains the typed query. The candidates for a query are a subset of the
+ * candidates of its prefix, so each typed character only checks the previous
+ * candidates, which are kept on a stack to make deleting a character free.
+ */
+
+#define FILTER_MAX_QUERY 64
+
+typedef struct level
+{
+    size_t offset; // into candidates
+    size_t count;
+} Level;
+
+static char **haystacks = NULL;
+static size_t num_windows = 0;
+
+static size_t *candidates = NULL; // the candidate indices of all levels
+static size_t candidates_capacity = 0;
+static size_t *depths = NULL; // the deepest level each window is a candidate in
+
+static Level levels[FILTER_MAX_QUERY + 1];
+static char query[FILTER_MAX_QUERY + 1];
+static size_t query_length = 0;
+
+static char *append_lowercase(char *dest, const char *src)
+{
+    for (; src != NULL && *src != '\0'; src++)
+    {
+        *dest++ = tolower((unsigned char) *src);
+    }
+
+    return dest;
+}
+
+static char *make_haystack(const Window *win)
+{
+    size_t length = (win->title != NULL ? strlen(win->title) : 0) +
+                    (win->class_name != NULL ? strlen(win->class_name) : 0) +
+                    (win->instance != NULL ? strlen(win->instance) : 0);
+
+    char *haystack = malloc(length + 3);
+    if (haystack == NULL)
+    {
+        return NULL;
+    }
+
+    // the separators cannot be typed, so matches don't span several fields
+    char *end = append_lowercase(haystack, win->title);
+    *end++ = '\n';
+    end = append_lowercase(end, win->class_name);
+    *end++ = '\n';
+    end = append_lowercase(end, win->instance);
+    *end = '\0';
+
+    return haystack;
+}
+
+static int reserve_candidates(size_t count)
+{
+    if (count <= candidates_capacity)
+    {
+        return 0;
+    }
+
+    size_t capacity = candidates_capacity == 0 ? count : candidates_capacity;
+    while (capacity < count)
+    {
+        capacity *= 2;
+    }
+
+    size_t *resized = realloc(candidates, sizeof(size_t) * capacity);
+    if (resized == NULL)
+    {
+        return 1;
+    }
+
+    candidates = resized;
+    candidates_capacity = capacity;
+    return 0;
+}
+
+static void free_haystacks()
+{
+    size_t i;
+    for (i = 0; i < num_windows; i++)
+    {
+        free(haystacks[i]);
+    }
+
+    free(haystacks);
+    free(depths);
+    haystacks = NULL;
+    depths = NULL;
+    num_windows = 0;
+}
+
+static int narrow(char c)
+{
+    Level *top = &levels[query_length];
+    if (reserve_candidates(top->offset + 2 * top->count))
+    {
+        LOG("cannot allocate filter candidates\n");
+        return 1;
+    }
+
+    query[query_length++] = tolower((unsigned char) c);
+    query[query_length] = '\0';
+
+    Level *next = &levels[query_length];
+    next->offset = top->offset + top->count;
+    next->count = 0;
+
+    size_t i;
+    for (i = 0; i < top->count; i++)
+    {
+        size_t index = candidates[top->offset + i];
+        if (strstr(haystacks[index], query) != NULL)
+        {
+            candidates[next->offset + next->count++] = index;
+            depths[index] = query_length;
+        }
+    }
+
+    LOG("filter '%s' matches %lu windows\n", query, next->count);
+    return 0;
+}
+
+/*
+ * Builds the index for a new snapshot of the windows. A query typed for the
+ * previous snapshot is applied to the new one.
+ */
+int filter_init(Window *windows)
+{
+    free_haystacks();
+
+    Window *win;
+    for (win = windows; win != NULL; win = win->next)
+    {
+        num_windows++;
+    }
+
+    haystacks = calloc(num_windows, sizeof(char *));
+    depths = calloc(num_windows, sizeof(size_t));
+    if (haystacks == NULL || depths == NULL || reserve_candidates(num_windows))
+    {
+        LOG("cannot allocate filter index\n");
+        free(haystacks);
+        free(depths);
+        haystacks = NULL;
+        depths = NULL;
+        num_windows = 0;
+        return 1;
+    }
+
+    size_t i = 0;
+    for (win = windows; win != NULL; win = win->next, i++)
+    {
+        haystacks[i] = make_haystack(win);
+        if (haystacks[i] == NULL)
+        {
+            LOG("cannot allocate filter index\n");
+            free_haystacks();
+            return 1;
+        }
+
+        candidates[i] = i;
+    }
+
+    levels[0].offset = 0;
+    levels[0].count = num_windows;
+
+    char replay[FILTER_MAX_QUERY + 1];
+    size_t replay_length = query_length;
+    memcpy(replay, query, query_length);
+    filter_reset();
+
+    for (i = 0; i < replay_length; i++)
+    {
+        if (narrow(replay[i]))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int filter_push(char c)
+{
+    if (query_length == FILTER_MAX_QUERY)
+    {
+        LOG("filter query too long\n");
+        return 1;
+    }
+
+    return narrow(c);
+}
+
+void filter_pop()
+{
+    if (query_length == 0)
+    {
+        return;
+    }
+
+    Level *top = &levels[query_length];
+    size_t i;
+    for (i = 0; i < top->count; i++)
+    {
+        depths[candidates[top->offset + i]]--;
+    }
+
+    query[--query_length] = '\0';
+}
+
+void filter_reset()
+{
+    size_t i;
+    for (i = 0; i < num_windows; i++)
+    {
+        depths[i] = 0;
+    }
+
+    query_length = 0;
+    query[0] = '\0';
+}
+
+size_t filter_count()
+{
+    return levels[query_length].count;
+}
+
+int filter_is_candidate(size_t index)
+{
+    return index < num_windows && depths[index] == query_length;
+}
+
+void filter_free()
+{
+    free_haystacks();
+    free(candidates);
+    candidates = NULL;
+    candidates_capacity = 0;
+    query_length = 0;
+    query[0] = '\0';
+}
@@ -0,0 +1,15 @@
+#ifndef I3_EASYFOCUS_FILTER
+#define I3_EASYFOCUS_FILTER
+
+#include <stddef.h>
+#include "win.h"
+
+int filter_init(Window *windows);
+int filter_push(char c);
+void filter_pop();
+void filter_reset();
+size_t filter_count();
+int filter_is_candidate(size_t index);
+void filter_free();
+
+#endif
@@ -1,7 +1,13 @@
 #include "ipc.h"
 #include "xcb.h"
 #include "map.h"
+#include "place.h"
+#include "filter.h"
+#include "print.h"
+#include "stable.h"
 #include "util.h"
+#include "trace.h"
+#include "record.h"
 #include "color_config.h"
 #include "config.h"
 
@@ -9,18 +15,40 @@
 #include <stdbool.h>
 #include <string.h>
 #include <getopt.h>
+#include <pthread.h>
 #include <X11/keysym.h>
 #include <X11/keysymdef.h>
 
 static int print_id = 0;
 static int window_id = 0;
+static int print_json = 0;
+static char *exec_command = NULL;
+
+typedef enum
+{
+    DUMP_NONE,
+    DUMP_JSON,
+    DUMP_TSV
+} DumpFormat;
+
+static DumpFormat dump_format = DUMP_NONE;
 static int rapid_mode = 0;
+static int filter_mode = 0;
+static int stable_mode = 0;
+static int choosing_label = 0;
 static SearchArea search_area = CURRENT_OUTPUT;
 static SortMethod sort_method = BY_LOCATION;
-static char *font_name = XCB_DEFAULT_FONT_NAME;
+static LabelOrder label_order = ORDER_TREE;
+static Criteria criteria = {NULL, NULL, NULL, 0, 0};
+static regex_t class_regex, instance_regex, title_regex;
+static char *font_name = NULL;
 static label_key_mode_e key_mode = LABEL_KEY_MODE_DEFAULT;
 static ColorConfig color_config = { COLOR_DEFAULT_URGENT_BG, COLOR_DEFAULT_URGENT_FG, COLOR_DEFAULT_FOCUSED_BG, COLOR_DEFAULT_FOCUSED_FG, COLOR_DEFAULT_UNFOCUSED_BG, COLOR_DEFAULT_UNFOCUSED_FG };
 static uint16_t modifier_mask = 0;
+static int trace_enabled = 0;
+static int trace_strict = 0;
+static char *trace_path = NULL;
+static char *record_path = NULL;
 
 static void print_help(void)
 {
@@ -28,15 +56,32 @@ static void print_help(void)
     fprintf(stderr, " -h --help              show this message\n");
     fprintf(stderr, " -i --con-id            print con id, does not change focus\n");
     fprintf(stderr, " -w --window-id         print window id, does not change focus\n");
+    fprintf(stderr, " --print-json           print con id, window id, geometry, workspace, output,\n");
+    fprintf(stderr, "                        type and urgency as JSON, does not change focus\n");
     fprintf(stderr, " -a --all               label visible windows on all outputs\n");
     fprintf(stderr, " -c --current           label visible windows within current container\n");
+    fprintf(stderr, " -e --everywhere        like --all, but also list windows on hidden workspaces\n");
+    fprintf(stderr, "                        and in the scratchpad, grouped by workspace\n");
+    fprintf(stderr, " -x --exec <cmd>        send the i3 command <cmd> for the selected window instead\n");
+    fprintf(stderr, "                        of focusing it, %%con_id and %%window_id are replaced by its ids\n");
+    fprintf(stderr, " --class <regex>        only label windows whose class matches <regex>\n");
+    fprintf(stderr, " --instance <regex>     only label windows whose instance matches <regex>\n");
+    fprintf(stderr, " --title <regex>        only label windows whose title matches <regex>\n");
+    fprintf(stderr, " --tiling               only label tiling windows\n");
+    fprintf(stderr, " --floating             only label floating windows\n");
     fprintf(stderr, " -r --rapid             rapid mode, keep on running until Escape is pressed\n");
+    fprintf(stderr, " -t --filter            type to narrow the labels down by title, class or instance,\n");
+    fprintf(stderr, "                        Tab then selects by label, Return the first window\n");
     fprintf(stderr, " -m --modifier <mod>    listen to keycombo <mod>+<label> instead of only <label>\n");
     fprintf(stderr, "                            - ctrl, shift, mod1, mod2, mod3, mod4, mod5\n");
     fprintf(stderr, "                            - or combine with, e.g., mod1+shift\n");
-    fprintf(stderr, " -s --sort-by <method>  how to sort the workspaces' labels when using --all:\n");
+    fprintf(stderr, " -s --sort-by <method>  how to sort the workspaces' labels when using --all/--everywhere:\n");
     fprintf(stderr, "                            - <location> based on their location (default)\n");
     fprintf(stderr, "                            - <num> using the workspaces' numbers\n");
+    fprintf(stderr, " --stable               give windows the key they had the last time, if it is free\n");
+    fprintf(stderr, " -o --order <order>     which windows get the first keys of the set:\n");
+    fprintf(stderr, "                            - <tree> in the order of the tree (default)\n");
+    fprintf(stderr, "                            - <proximity> the ones closest to the focused window\n");
     fprintf(stderr, " -f --font <font-name>  set font name, see `xlsfonts` for available fonts\n");
     fprintf(stderr, " -k --keys <mode>       set the labeling keys to use:\n");
     fprintf(stderr, "                            - <avy> prefers home row for qwerty (default)\n");
@@ -48,6 +93,48 @@ static void print_help(void)
     fprintf(stderr, " --color-urgent-fg <rgb>    set label foreground color of urgent windows, e.g., FF00FF\n");
     fprintf(stderr, " --color-focused-fg <rgb>   set label foreground color of focused windows, e.g., FF00FF\n");
     fprintf(stderr, " --color-unfocused-fg <rgb> set label foreground color of unfocused windows, e.g., FF00FF\n");
+    fprintf(stderr, " --dump[=json|tsv]          print the windows and the labels they would get, without\n");
+    fprintf(stderr, "                            connecting to X. tsv columns: con id, window id, label,\n");
+    fprintf(stderr, "                            x, y, type, workspace, title\n");
+    fprintf(stderr, " --trace[=<file>]           write per-phase timings as JSON lines to <file> (default: stderr)\n");
+    fprintf(stderr, " --trace-strict[=<file>]    like --trace, but exit with failure if a phase went over its\n");
+    fprintf(stderr, "                            budget of round trips\n");
+    fprintf(stderr, " --record <file>            record the i3 requests, replies and events and the X events\n");
+    fprintf(stderr, "                            of the session to <file>, for bench/replay-i3\n");
+}
+
+static void compile_criterion(regex_t *regex, regex_t **criterion, const char *pattern)
+{
+    if (*criterion != NULL)
+    {
+        regfree(*criterion);
+        *criterion = NULL;
+    }
+
+    int err = regcomp(regex, pattern, REG_EXTENDED | REG_NOSUB);
+    if (err != 0)
+    {
+        char msg[256];
+        regerror(err, regex, msg, sizeof(msg));
+        fprintf(stderr, "invalid regex '%s': %s\n", pattern, msg);
+        exit(EXIT_FAILURE);
+    }
+
+    *criterion = regex;
+}
+
+static void free_criteria()
+{
+    regex_t **regexes[] = {&criteria.class_name, &criteria.instance, &criteria.title};
+    size_t i;
+    for (i = 0; i < sizeof(regexes) / sizeof(regexes[0]); i++)
+    {
+        if (*regexes[i] != NULL)
+        {
+            regfree(*regexes[i]);
+            *regexes[i] = NULL;
+        }
+    }
 }
 
 static void parse_args(int argc, char *argv[])
@@ -57,8 +144,12 @@ static void parse_args(int argc, char *argv[])
         {"window-id", no_argument, 0, 'w'},
         {"all", no_argument, 0, 'a'},
         {"current", no_argument, 0, 'c'},
+        {"everywhere", no_argument, 0, 'e'},
+        {"exec", required_argument, 0, 'x'},
         {"rapid", no_argument, 0, 'r'},
+        {"filter", no_argument, 0, 't'},
         {"font", required_argument, 0, 'f'},
+        {"order", required_argument, 0, 'o'},
         {"modifier", required_argument, 0, 'm'},
         {"color-urgent-bg", required_argument, 0, 1000},
         {"color-focused-bg", required_argument, 0, 1001},
@@ -66,10 +157,21 @@ static void parse_args(int argc, char *argv[])
         {"color-urgent-fg", required_argument, 0, 1003},
         {"color-focused-fg", required_argument, 0, 1004},
         {"color-unfocused-fg", required_argument, 0, 1005},
+        {"trace", optional_argument, 0, 1006},
+        {"print-json", no_argument, 0, 1007},
+        {"dump", optional_argument, 0, 1008},
+        {"class", required_argument, 0, 1009},
+        {"instance", required_argument, 0, 1010},
+        {"title", required_argument, 0, 1011},
+        {"tiling", no_argument, 0, 1012},
+        {"floating", no_argument, 0, 1013},
+        {"stable", no_argument, 0, 1014},
+        {"record", required_argument, 0, 1015},
+        {"trace-strict", optional_argument, 0, 1016},
         {"help", no_argument, 0, 'h'},
         {"keys", required_argument, 0, 'k'},
         {0, 0, 0, 0}};
-    char *options_string = "iwacrf:s:hk:m:";
+    char *options_string = "iwacertf:s:hk:m:x:o:";
     int o, option_index;
 
     bool got_sort_method = false;
@@ -82,10 +184,12 @@ static void parse_args(int argc, char *argv[])
             exit(0);
         case 'i':
             print_id = 1;
+            print_json = 0;
             window_id = 0;
             break;
         case 'w':
             print_id = 1;
+            print_json = 0;
             window_id = 1;
             break;
         case 'a':
@@ -94,10 +198,20 @@ static void parse_args(int argc, char *argv[])
         case 'c':
             search_area = CURRENT_CONTAINER;
             break;
+        case 'e':
+            search_area = EVERYWHERE;
+            break;
+        case 'x':
+            exec_command = optarg;
+            break;
         case 'r':
             rapid_mode = 1;
             break;
+        case 't':
+            filter_mode = 1;
+            break;
         case 'f':
+            free(font_name);
             font_name = strdup(optarg);
             break;
         case 'm':
@@ -141,6 +255,22 @@ static void parse_args(int argc, char *argv[])
                 print_help();
                 exit(EXIT_FAILURE);
             }
+        case 'o':
+            if (strcmp(optarg, "tree") == 0)
+            {
+                label_order = ORDER_TREE;
+            }
+            else if (strcmp(optarg, "proximity") == 0)
+            {
+                label_order = ORDER_PROXIMITY;
+            }
+            else
+            {
+                fprintf(stderr, "unknown label order: %s\n", optarg);
+                print_help();
+                exit(EXIT_FAILURE);
+            }
+            break;
         case 1000:
             if (parse_rgb_string(optarg, &(color_config.urgent_bg))) {
                 fprintf(stderr, "cannot parse rgb string: %s\n", optarg);
@@ -177,65 +307,664 @@ static void parse_args(int argc, char *argv[])
                 exit(EXIT_FAILURE);
             }
             break;
+        case 1006:
+            trace_enabled = 1;
+            trace_path = optarg;
+            break;
+        case 1016:
+            trace_enabled = 1;
+            trace_strict = 1;
+            trace_path = optarg;
+            break;
+        case 1007:
+            print_id = 1;
+            print_json = 1;
+            break;
+        case 1008:
+            if (optarg == NULL || strcmp(optarg, "json") == 0)
+            {
+                dump_format = DUMP_JSON;
+            }
+            else if (strcmp(optarg, "tsv") == 0)
+            {
+                dump_format = DUMP_TSV;
+            }
+            else
+            {
+                fprintf(stderr, "unknown dump format: %s\n", optarg);
+                print_help();
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 1009:
+            compile_criterion(&class_regex, &criteria.class_name, optarg);
+            break;
+        case 1010:
+            compile_criterion(&instance_regex, &criteria.instance, optarg);
+            break;
+        case 1011:
+            compile_criterion(&title_regex, &criteria.title, optarg);
+            break;
+        case 1012:
+            criteria.tiling = 1;
+            criteria.floating = 0;
+            break;
+        case 1014:
+            stable_mode = 1;
+            break;
+        case 1015:
+            record_path = optarg;
+            break;
+        case 1013:
+            criteria.floating = 1;
+            criteria.tiling = 0;
+            break;
         default:
             print_help();
             exit(EXIT_FAILURE);
         }
     }
-    if (got_sort_method && search_area != ALL_OUTPUTS)
-        fprintf(stderr, "warning: ignoring provided --sort-by argument, use the --all flag.\n");
+    if (got_sort_method && search_area != ALL_OUTPUTS && search_area != EVERYWHERE)
+        fprintf(stderr, "warning: ignoring provided --sort-by argument, use the --all or --everywhere flag.\n");
 }
 
-static int create_window_label(Window *win)
+/*
+ * With --stable, a window gets the key it had the last time, unless that key
+ * is taken already or not in the set. Otherwise the first free key is used.
+ */
+static xcb_keysym_t add_window_key(Window *win)
 {
-    xcb_keysym_t key = map_add(win);
-    if (key == XCB_NO_SYMBOL)
+    if (stable_mode)
     {
-        fprintf(stderr, "cannot find a free keysym\n");
-        return 1;
+        xcb_keysym_t key = map_add_key(win, stable_key(win, NULL));
+        if (key != XCB_NO_SYMBOL)
+        {
+            return key;
+        }
+    }
+
+    return map_add(win);
+}
+
+typedef struct remembered_key
+{
+    size_t age; // 0 for the most recently labelled window
+    size_t index;
+    Window *win;
+    xcb_keysym_t keysym;
+} RememberedKey;
+
+static int compare_remembered_keys(const void *a, const void *b)
+{
+    const RememberedKey *ka = a;
+    const RememberedKey *kb = b;
+    if (ka->age != kb->age)
+    {
+        return ka->age < kb->age ? -1 : 1;
+    }
+
+    return ka->index < kb->index ? -1 : (ka->index > kb->index);
+}
+
+/*
+ * Assigns the keys of all windows. The remembered keys are handed out first,
+ * from the most recently labelled window on, so of two windows that remember
+ * the same key the one that had it last keeps it, and windows without one
+ * cannot take it away.
+ */
+static void add_window_keys(Window *win, xcb_keysym_t *keys)
+{
+    Window *curr;
+    size_t i;
+    for (curr = win, i = 0; curr != NULL; curr = curr->next, i++)
+    {
+        keys[i] = XCB_NO_SYMBOL;
+    }
+
+    RememberedKey *remembered = stable_mode ? malloc(sizeof(RememberedKey) * (i + 1)) : NULL;
+    if (remembered != NULL)
+    {
+        size_t count = 0;
+        for (curr = win, i = 0; curr != NULL; curr = curr->next, i++)
+        {
+            RememberedKey *key = &remembered[count];
+            key->keysym = stable_key(curr, &key->age);
+            key->index = i;
+            key->win = curr;
+            count += (key->keysym != XCB_NO_SYMBOL);
+        }
+
+        qsort(remembered, count, sizeof(RememberedKey), compare_remembered_keys);
+        for (i = 0; i < count; i++)
+        {
+            keys[remembered[i].index] = map_add_key(remembered[i].win, remembered[i].keysym);
+        }
+
+        free(remembered);
+    }
+
+    for (curr = win, i = 0; curr != NULL; curr = curr->next, i++)
+    {
+        if (keys[i] == XCB_NO_SYMBOL)
+        {
+            keys[i] = map_add(curr);
+        }
+    }
+}
+
+static void remember_window_keys(Window *win)
+{
+    Window *curr;
+    for (curr = win; curr != NULL; curr = curr->next)
+    {
+        // filtered out windows have no key, they keep the one remembered
+        xcb_keysym_t key = map_get_keysym(curr);
+        if (key != XCB_NO_SYMBOL)
+        {
+            stable_remember(curr, key);
+        }
     }
 
+    stable_store();
+}
+
+static int grab_window_label(xcb_keysym_t key)
+{
+    // budgets of the traced phases scale with the number of labels
+    trace_items(1);
     if (xcb_grab_keysym(key, modifier_mask))
     {
         fprintf(stderr, "cannot register for key event\n");
         return 1;
     }
 
-    char *label = xcb_keysym_to_string(key);
-    if (label == NULL)
+    return 0;
+}
+
+/*
+ * Labels of windows on hidden workspaces are listed instead of drawn on top
+ * of the window, so they also name the workspace and the window.
+ */
+static const char *window_label_text(Window *win, const char *name, char *caption)
+{
+    if (!win->hidden)
+    {
+        return name;
+    }
+
+    snprintf(caption, HIDDEN_CAPTION_LENGTH + 1, "%s %s: %s",
+             name,
+             win->workspace != NULL ? win->workspace : "?",
+             win->title != NULL ? win->title : (win->class_name != NULL ? win->class_name : ""));
+    return caption;
+}
+
+static int create_window_label(Window *win)
+{
+    xcb_keysym_t key = map_get_keysym(win);
+    const char *name = map_keysym_name(key);
+    if (name == NULL)
     {
-        fprintf(stderr, "cannot convert keysym to string\n");
+        fprintf(stderr, "no name for keysym %u, see src/map.c\n", key);
         return 1;
     }
 
-    if (xcb_create_text_window(win->position.x, win->position.y, win->type, label))
+    char caption[HIDDEN_CAPTION_LENGTH + 1];
+    const char *label = window_label_text(win, name, caption);
+    trace_items(1);
+
+    xcb_window_t label_window;
+    if (xcb_create_text_window(win->position.x, win->position.y, win->type, label, &label_window))
     {
         fprintf(stderr, "cannot create text window\n");
-        free(label);
         return 1;
     }
 
-    free(label);
+    map_set_label(key, label_window);
     return 0;
 }
 
+static int update_window_label(Window *win)
+{
+    xcb_keysym_t key = map_get_keysym(win);
+    if (key == XCB_NO_SYMBOL)
+    {
+        // filtered out, there is no label to update
+        return 0;
+    }
+
+    const char *name = map_keysym_name(key);
+    if (name == NULL)
+    {
+        fprintf(stderr, "no name for keysym %u, see src/map.c\n", key);
+        return 1;
+    }
+
+    char caption[HIDDEN_CAPTION_LENGTH + 1];
+    const char *label = window_label_text(win, name, caption);
+    trace_items(1);
+    if (xcb_update_text_window(map_get_label(key), win->position.x, win->position.y, win->type, label))
+    {
+        fprintf(stderr, "cannot update text window\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+static void remove_window_label(Window *win)
+{
+    xcb_keysym_t key = map_get_keysym(win);
+    if (key == XCB_NO_SYMBOL)
+    {
+        // there were more windows than keys, it had no label
+        return;
+    }
+
+    xcb_hide_text_window(map_get_label(key));
+    xcb_ungrab_keysym(key, modifier_mask);
+    map_remove(key);
+}
+
 static int create_window_labels(Window *win)
 {
+    trace_begin(TRACE_KEY_GRABS);
+    if (xcb_grab_keysym(EXIT_KEYSYM, modifier_mask))
+    {
+        trace_end(TRACE_KEY_GRABS);
+        fprintf(stderr, "cannot grab exit keysym\n");
+        return 1;
+    }
+
+    xcb_keysym_t *keys = malloc(sizeof(xcb_keysym_t) * (window_count(win) + 1));
+    add_window_keys(win, keys);
+
+    // windows beyond the number of keys are left without a label
+    size_t unlabelled = 0;
+    Window *curr;
+    size_t i;
+    for (curr = win, i = 0; curr != NULL; curr = curr->next, i++)
+    {
+        if (keys[i] == XCB_NO_SYMBOL)
+        {
+            unlabelled++;
+        }
+        else if (grab_window_label(keys[i]))
+        {
+            free(keys);
+            trace_end(TRACE_KEY_GRABS);
+            return 1;
+        }
+    }
+    free(keys);
+    trace_end(TRACE_KEY_GRABS);
+
+    if (unlabelled > 0)
+    {
+        fprintf(stderr, "warning: %lu windows have no label, there are not enough keys.\n", (unsigned long) unlabelled);
+    }
+
+    trace_begin(TRACE_LABELS);
+    int first = 1;
+    for (curr = win; curr != NULL; curr = curr->next)
+    {
+        if (map_get_keysym(curr) == XCB_NO_SYMBOL)
+        {
+            continue;
+        }
+
+        // the first label is traced on its own, as it is the first thing the user sees
+        if (first)
+        {
+            trace_begin(TRACE_FIRST_EXPOSE);
+        }
+
+        int failed = create_window_label(curr);
+
+        if (first)
+        {
+            trace_end(TRACE_FIRST_EXPOSE);
+            first = 0;
+        }
+
+        if (failed)
+        {
+            trace_end(TRACE_LABELS);
+            return 1;
+        }
+    }
+    trace_end(TRACE_LABELS);
+
+    return 0;
+}
+
+/*
+ * Labels the windows that match the filter, so that the remaining windows
+ * get the best keys. Label windows of the previous assignment are reused.
+ */
+static int label_filtered_windows(Window *old, Window *win)
+{
+    xcb_window_t *spare = malloc(sizeof(xcb_window_t) * (window_count(old) + 1));
+    Window *curr;
+    size_t num_spare = 0;
+    for (curr = old; curr != NULL; curr = curr->next)
+    {
+        xcb_window_t label = map_get_label(map_get_keysym(curr));
+        if (label != XCB_WINDOW_NONE)
+        {
+            spare[num_spare++] = label;
+        }
+    }
+
+    map_free();
     map_init(key_mode);
-    Window *curr = win;
-    while (curr != NULL)
+
+    size_t next_spare = 0;
+    size_t index = 0;
+    int failed = 0;
+    for (curr = win; curr != NULL && !failed; curr = curr->next, index++)
+    {
+        if (!filter_is_candidate(index))
+        {
+            continue;
+        }
+
+        xcb_keysym_t key = add_window_key(curr);
+        if (key == XCB_NO_SYMBOL)
+        {
+            // more matches than keys, typing further narrows them down
+            break;
+        }
+
+        if (next_spare < num_spare)
+        {
+            map_set_label(key, spare[next_spare++]);
+            failed = update_window_label(curr);
+        }
+        else
+        {
+            failed = create_window_label(curr);
+        }
+    }
+
+    for (; next_spare < num_spare; next_spare++)
+    {
+        xcb_hide_text_window(spare[next_spare]);
+    }
+
+    free(spare);
+    return failed;
+}
+
+static int create_filtered_labels(Window *win)
+{
+    trace_begin(TRACE_KEY_GRABS);
+    int grab_failed = xcb_grab_keyboard_input();
+    trace_end(TRACE_KEY_GRABS);
+    if (grab_failed)
+    {
+        fprintf(stderr, "cannot grab keyboard\n");
+        return 1;
+    }
+
+    if (filter_init(win))
+    {
+        fprintf(stderr, "cannot build filter index\n");
+        return 1;
+    }
+
+    trace_begin(TRACE_LABELS);
+    int failed = label_filtered_windows(NULL, win);
+    trace_end(TRACE_LABELS);
+
+    return failed;
+}
+
+static xcb_keysym_t first_filtered_label(Window *win)
+{
+    size_t index = 0;
+    for (; win != NULL; win = win->next, index++)
+    {
+        if (filter_is_candidate(index))
+        {
+            return map_get_keysym(win);
+        }
+    }
+
+    return XCB_NO_SYMBOL;
+}
+
+/*
+ * Handles a key press while filtering. Sets key to the label to select, or to
+ * XCB_NO_SYMBOL if there is nothing to select yet. Returns 1 on failure.
+ */
+static int filter_input(Window *win, xcb_keysym_t *key)
+{
+    xcb_keysym_t pressed = *key;
+    *key = XCB_NO_SYMBOL;
+
+    if (choosing_label)
+    {
+        // with the keyboard grabbed, any key arrives here, not only labels,
+        // and with its shift level
+        choosing_label = 0;
+        if (pressed >= XK_A && pressed <= XK_Z)
+        {
+            pressed += XK_a - XK_A;
+        }
+        *key = map_get(pressed) != NULL ? pressed : XCB_NO_SYMBOL;
+        return 0;
+    }
+
+    if (pressed == FILTER_CHOOSE_KEYSYM)
+    {
+        choosing_label = 1;
+        return 0;
+    }
+
+    if (pressed == FILTER_ACCEPT_KEYSYM)
+    {
+        *key = first_filtered_label(win);
+        return 0;
+    }
+
+    if (pressed == FILTER_DELETE_KEYSYM)
+    {
+        filter_pop();
+    }
+    else if (pressed < 0x20 || pressed > 0x7e || filter_push((char) pressed))
+    {
+        // only latin-1 keysyms match their character
+        return 0;
+    }
+
+    if (label_filtered_windows(win, win))
+    {
+        return 1;
+    }
+
+    if (filter_count() == 1)
+    {
+        *key = first_filtered_label(win);
+    }
+
+    return 0;
+}
+
+static Window *find_window(Window *win, unsigned long id)
+{
+    for (; win != NULL; win = win->next)
+    {
+        if (win->id == id)
+        {
+            return win;
+        }
+    }
+
+    return NULL;
+}
+
+static int set_window_type(Window *win, WindowType type)
+{
+    if (win->type == type)
+    {
+        return 0;
+    }
+
+    win->type = type;
+    return update_window_label(win);
+}
+
+/*
+ * Moves the focus highlight to target. Returns 1 if this changes which
+ * windows are visible, i.e., if the labels have to be laid out again.
+ */
+static int apply_focus(Window *win, Window *target, int urgent)
+{
+    if (target == NULL || target->is_tab)
+    {
+        return 1;
+    }
+
+    Window *curr;
+    for (curr = win; curr != NULL; curr = curr->next)
+    {
+        if (curr != target && curr->type == FOCUSED_WINDOW && set_window_type(curr, UNFOCUSED_WINDOW))
+        {
+            return 1;
+        }
+    }
+
+    return set_window_type(target, urgent ? URGENT_WINDOW : FOCUSED_WINDOW);
+}
+
+/*
+ * Applies the focus and urgency changes reported by i3 to the labels. Returns
+ * 1 if any event requires the visible windows to be fetched again.
+ */
+static int apply_events(Window *win, IpcEvent *events)
+{
+    IpcEvent *event;
+    for (event = events; event != NULL; event = event->next)
+    {
+        if (event->type == IPC_EVENT_LAYOUT || event->type == IPC_EVENT_CLOSE)
+        {
+            return 1;
+        }
+
+        Window *target = find_window(win, event->id);
+        if (event->type == IPC_EVENT_FOCUS)
+        {
+            if (apply_focus(win, target, event->urgent))
+            {
+                return 1;
+            }
+        }
+        else if (target == NULL)
+        {
+            return 1;
+        }
+        else if (set_window_type(target, event->urgent ? URGENT_WINDOW : UNFOCUSED_WINDOW))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int window_closed(IpcEvent *events, Window *win)
+{
+    IpcEvent *event;
+    for (event = events; event != NULL; event = event->next)
     {
-        if (create_window_label(curr))
+        if (event->type == IPC_EVENT_CLOSE && event->id == win->id)
         {
             return 1;
         }
+    }
+
+    return 0;
+}
+
+/*
+ * Moves the labels from the previously visible windows over to the current
+ * ones. Windows that are still visible keep their key and label window, which
+ * is only repainted if the window moved or changed its state.
+ */
+static int relabel_windows(Window *old, Window *win)
+{
+    Window *curr;
+    for (curr = old; curr != NULL; curr = curr->next)
+    {
+        if (find_window(win, curr->id) == NULL)
+        {
+            remove_window_label(curr);
+        }
+    }
+
+    for (curr = win; curr != NULL; curr = curr->next)
+    {
+        Window *prev = find_window(old, curr->id);
+        if (prev == NULL || map_get_keysym(prev) == XCB_NO_SYMBOL)
+        {
+            continue;
+        }
+
+        map_replace(map_get_keysym(prev), curr);
+        if (prev->position.x != curr->position.x ||
+            prev->position.y != curr->position.y ||
+            prev->type != curr->type)
+        {
+            if (update_window_label(curr))
+            {
+                return 1;
+            }
+        }
+    }
+
+    // new windows, and those that found no free key before, take the keys
+    // that are left
+    for (curr = win; curr != NULL; curr = curr->next)
+    {
+        if (map_get_keysym(curr) != XCB_NO_SYMBOL)
+        {
+            continue;
+        }
 
-        curr = curr->next;
+        xcb_keysym_t key = add_window_key(curr);
+        if (key == XCB_NO_SYMBOL)
+        {
+            LOG("no key left (id: %lu)\n", curr->id);
+            continue;
+        }
+
+        if (grab_window_label(key) || create_window_label(curr))
+        {
+            return 1;
+        }
     }
 
     return 0;
 }
 
+static void watch_windows(Window *win)
+{
+    uint32_t *win_ids = malloc((window_count(win) + 1) * sizeof(uint32_t));
+    size_t count = 0;
+    Window *curr;
+    for (curr = win; curr != NULL; curr = curr->next)
+    {
+        if (curr->win_id != 0)
+        {
+            win_ids[count++] = curr->win_id;
+        }
+    }
+
+    xcb_watch_windows(win_ids, count);
+    free(win_ids);
+}
+
 static int handle_selection(xcb_keysym_t selection)
 {
     Window *win = map_get(selection);
@@ -248,15 +977,24 @@ static int handle_selection(xcb_keysym_t selection)
     LOG("window (id: %lu, window: %u)\n", win->id, win->win_id);
     if (print_id)
     {
-        if (window_id)
+        if (print_json)
+            return print_window_json(stdout, win);
+        else if (window_id)
             printf("%u\n", win->win_id);
         else
             printf("%lu\n", win->id);
     }
-    else if (ipc_focus_window(win))
+    else
     {
-        fprintf(stderr, "cannot focus window\n");
-        return 1;
+        // --exec reuses the connection instead of spawning i3-msg
+        trace_begin(TRACE_FOCUS);
+        int failed = exec_command != NULL ? ipc_exec_window(win, exec_command) : ipc_focus_window(win);
+        trace_end(TRACE_FOCUS);
+        if (failed)
+        {
+            fprintf(stderr, exec_command != NULL ? "cannot execute command\n" : "cannot focus window\n");
+            return 1;
+        }
     }
 
     return 0;
@@ -264,8 +1002,10 @@ static int handle_selection(xcb_keysym_t selection)
 
 static int setup_xcb()
 {
-    if (xcb_init(font_name, color_config))
+    trace_begin(TRACE_XCB_INIT);
+    if (xcb_init(font_name != NULL ? font_name : XCB_DEFAULT_FONT_NAME, color_config))
     {
+        trace_end(TRACE_XCB_INIT);
         fprintf(stderr, "error initializing xcb\n");
         return 1;
     }
@@ -273,92 +1013,289 @@ static int setup_xcb()
     if (xcb_register_configure_notify())
     {
         xcb_finish();
+        trace_end(TRACE_XCB_INIT);
         fprintf(stderr, "failed to register for configure notify\n");
         return 1;
     }
 
-    if (xcb_grab_keysym(EXIT_KEYSYM, modifier_mask))
+    trace_end(TRACE_XCB_INIT);
+    return 0;
+}
+
+static Window *place_labels(Window *win)
+{
+    int label_width, label_height;
+    xcb_label_size(&label_width, &label_height);
+
+    trace_begin(TRACE_PLACEMENT);
+    win = drop_occluded_windows(win);
+    place_windows(win, label_width, label_height);
+    trace_end(TRACE_PLACEMENT);
+
+    return win;
+}
+
+static void *fetch_visible_windows(void *result)
+{
+    *((Window **) result) = ipc_visible_windows(search_area, sort_method, &criteria, label_order);
+    return NULL;
+}
+
+static int select_window()
+{
+    // the labels are kept in sync with i3's events while they are shown
+    if (ipc_subscribe())
+    {
+        fprintf(stderr, "cannot subscribe to i3 events\n");
+        return 1;
+    }
+
+    // the tree and the X connection are independent until the labels are
+    // placed, so fetch the tree while setting up X.
+    Window *win = NULL;
+    pthread_t fetcher;
+    int threaded = (pthread_create(&fetcher, NULL, fetch_visible_windows, &win) == 0);
+    if (!threaded)
+    {
+        LOG("cannot start tree fetcher thread, fetching sequentially\n");
+        win = ipc_visible_windows(search_area, sort_method, &criteria, label_order);
+    }
+
+    int xcb_failed = setup_xcb();
+    if (threaded)
+    {
+        pthread_join(fetcher, NULL);
+    }
+
+    if (xcb_failed)
+    {
+        window_free(win);
+        return 1;
+    }
+
+    win = place_labels(win);
+    if (win == NULL)
     {
         xcb_finish();
-        fprintf(stderr, "cannot grab exit keysym\n");
+        fprintf(stderr, "no visible windows\n");
         return 1;
     }
 
-    return 0;
-}
+    if (stable_mode)
+    {
+        stable_load();
+    }
 
-static int select_window()
-{
-    int searching = 1;
-    while (searching)
+    map_init(key_mode);
+    int failed = filter_mode ? create_filtered_labels(win) : create_window_labels(win);
+    if (!failed)
     {
-        // TODO: should probably not reconnect to xserver each time
-        // - need to destroy all previous popup windows.
-        if (setup_xcb())
+        watch_windows(win);
+
+        // the labels are shown, so checking the cache doesn't delay them
+        xcb_sync_cache();
+    }
+
+    while (!failed)
+    {
+        trace_begin(TRACE_KEY_PRESS);
+        xcb_keysym_t selection = xcb_wait_for_user_input();
+        trace_end(TRACE_KEY_PRESS);
+
+        if (selection == EXIT_KEYSYM)
         {
-            return 1;
+            break;
         }
 
-        Window *win = ipc_visible_windows(search_area, sort_method);
-        if (win == NULL)
+        if (selection == XCB_CONNECTION_LOST)
         {
-            fprintf(stderr, "no visible windows\n");
-            return 1;
+            fprintf(stderr, "lost the connection to X\n");
+            failed = 1;
+            break;
         }
 
-        if (create_window_labels(win))
+        int is_key = (selection != XCB_NO_SYMBOL && selection != XCB_IPC_EVENTS);
+        if (filter_mode && is_key)
         {
-            map_free();
-            window_free(win);
-            return 1;
+            if (filter_input(win, &selection))
+            {
+                failed = 1;
+                break;
+            }
+
+            if (selection == XCB_NO_SYMBOL)
+            {
+                continue;
+            }
         }
 
-        xcb_keysym_t selection = xcb_wait_for_user_input();
-        xcb_finish();
+        // events that arrived before the key press are applied first, so that
+        // a window that is already gone cannot be selected
+        IpcEvent *events = ipc_poll_events();
+        int relayout = apply_events(win, events);
+        int done = 0;
 
-        if (selection != XCB_NO_SYMBOL)
+        if (selection == XCB_NO_SYMBOL)
+        {
+            // i3 doesn't report moved or resized windows as events
+            ipc_invalidate();
+            relayout = 1;
+        }
+        else if (is_key)
         {
             LOG("selection: %i\n", selection);
-            if (selection == EXIT_KEYSYM)
+            Window *target = map_get(selection);
+            if (target != NULL && window_closed(events, target))
+            {
+                LOG("selected window was closed (id: %lu)\n", target->id);
+            }
+            else if (!rapid_mode)
+            {
+                xcb_clear_labels();
+                failed = handle_selection(selection);
+                done = 1;
+            }
+            else if (handle_selection(selection))
             {
-                searching = 0;
+                failed = 1;
             }
-            else if (selection != EXIT_KEYSYM)
+            else
             {
-                if (handle_selection(selection))
+                // don't wait for i3's focus event to move the highlight
+                relayout = (!print_id && exec_command == NULL && apply_focus(win, target, 0)) || relayout;
+
+                if (filter_mode)
                 {
-                    map_free();
-                    window_free(win);
-                    return 1;
+                    filter_reset();
+                    relayout = 1;
                 }
+            }
+        }
+
+        ipc_event_free(events);
+        if (failed || done)
+        {
+            break;
+        }
 
-                searching = rapid_mode;
+        if (relayout)
+        {
+            Window *next = place_labels(ipc_visible_windows(search_area, sort_method, &criteria, label_order));
+            if (next == NULL)
+            {
+                fprintf(stderr, "no visible windows\n");
+                failed = 1;
+                break;
+            }
+
+            if (filter_mode)
+            {
+                failed = filter_init(next) || label_filtered_windows(win, next);
             }
+            else
+            {
+                failed = relabel_windows(win, next);
+            }
+            window_free(win);
+            win = next;
+            watch_windows(win);
         }
+    }
 
-        map_free();
-        window_free(win);
+    if (stable_mode && !failed)
+    {
+        remember_window_keys(win);
     }
 
-    return 0;
+    xcb_finish();
+    map_free();
+    filter_free();
+    stable_free();
+    window_free(win);
+
+    return failed;
+}
+
+/*
+ * Runs the walk, drops occluded windows and assigns the keys like
+ * select_window does, but without X: there are no fonts to size labels with,
+ * so labels are not moved apart and keep the position of the window's
+ * decoration.
+ */
+static int dump_windows()
+{
+    // without a tree, an empty list would look like there are no windows
+    if (ipc_refresh_tree())
+    {
+        fprintf(stderr, "cannot get the tree from i3\n");
+        return 1;
+    }
+
+    // occluded windows get no label when they are shown either, so they must
+    // not take a key here
+    Window *win = drop_occluded_windows(ipc_visible_windows(search_area, sort_method, &criteria, label_order));
+
+    // the remembered keys are only read, nothing was selected
+    if (stable_mode)
+    {
+        stable_load();
+    }
+
+    map_init(key_mode);
+    xcb_keysym_t *keys = malloc(sizeof(xcb_keysym_t) * (window_count(win) + 1));
+    add_window_keys(win, keys);
+    free(keys);
+
+    int failed = dump_format == DUMP_TSV ? print_labels_tsv(stdout, win) : print_labels_json(stdout, win);
+
+    map_free();
+    stable_free();
+    window_free(win);
+
+    return failed;
 }
 
 int main(int argc, char *argv[])
 {
     parse_args(argc, argv);
 
-    if (ipc_init())
+    if (trace_enabled && trace_init(trace_path))
     {
-        fprintf(stderr, "error initializing ipc\n");
+        fprintf(stderr, "cannot open trace output\n");
         return 1;
     }
 
-    if (select_window())
+    if (record_path != NULL && record_init(record_path, argc, argv))
     {
+        fprintf(stderr, "cannot open recording\n");
+        trace_finish();
         return 1;
     }
 
+    trace_begin(TRACE_IPC_INIT);
+    int ipc_failed = ipc_init();
+    trace_end(TRACE_IPC_INIT);
+    if (ipc_failed)
+    {
+        fprintf(stderr, "error initializing ipc\n");
+        trace_finish();
+        record_finish();
+        free(font_name);
+        free_criteria();
+        return 1;
+    }
+
+    int failed = dump_format != DUMP_NONE ? dump_windows() : select_window();
+
     ipc_finish();
+    if (trace_finish() > 0 && trace_strict)
+    {
+        fprintf(stderr, "phases over budget, see TRACE_BUDGETS in src/config.h\n");
+        failed = 1;
+    }
+    record_finish();
+    free(font_name);
+    free_criteria();
 
-    return 0;
+    return failed;
 }
@@ -1,357 +1,324 @@
 #include "ipc.h"
+#include "walk.h"
+#include "tree.h"
 #include "util.h"
+#include "trace.h"
+#include "probes.h"
+#include "record.h"
 
 #include <string.h>
 #include <stdlib.h>
 #include <i3ipc-glib/i3ipc-glib.h>
 
-#define BUFFER 512
-
 static i3ipcConnection *connection = NULL;
 
-static Window *con_to_window(i3ipcCon *con)
-{
-    unsigned long id;
-    g_object_get(con, "id", &id, NULL);
-
-    uint32_t win_id;
-    g_object_get(con, "window", &win_id, NULL);
-
-    i3ipcRect *deco_rect = NULL;
-    g_object_get(con, "deco_rect", &deco_rect, NULL);
+// the tree is kept in sync with i3's events and only fetched again after
+// changes that cannot be applied to it
+static Tree *tree = NULL;
+static int tree_stale = 1;
 
-    gboolean fullscreen;
-    g_object_get(con, "fullscreen-mode", &fullscreen, NULL);
+static IpcEvent *events_head = NULL;
+static IpcEvent *events_tail = NULL;
 
-    gboolean urgent;
-    g_object_get(con, "urgent", &urgent, NULL);
-
-    gboolean focused;
-    g_object_get(con, "focused", &focused, NULL);
+static void push_event(IpcEventType type, unsigned long id, int urgent)
+{
+    IpcEvent *event = malloc(sizeof(IpcEvent));
+    event->next = NULL;
+    event->type = type;
+    event->id = id;
+    event->urgent = urgent;
 
-    int x, y;
-    if (fullscreen || (deco_rect->height == 0))
+    if (events_tail == NULL)
     {
-        i3ipcRect *rect = NULL;
-        g_object_get(con, "rect", &rect, NULL);
-
-        x = rect->x;
-        y = rect->y;
-
-        i3ipc_rect_free(rect);
+        events_head = event;
     }
     else
     {
-        i3ipcCon *parent = NULL;
-        g_object_get(con, "parent", &parent, NULL);
+        events_tail->next = event;
+    }
+    events_tail = event;
+}
 
-        i3ipcRect *parent_rect = NULL;
-        g_object_get(parent, "rect", &parent_rect, NULL);
+static void on_window_event(i3ipcConnection *conn, i3ipcWindowEvent *e, gpointer data)
+{
+    (void) conn;
+    (void) data;
 
-        x = parent_rect->x + deco_rect->x;
-        y = parent_rect->y + deco_rect->y;
+    unsigned long id;
+    gboolean urgent;
+    g_object_get(e->container, "id", &id, "urgent", &urgent, NULL);
+    LOG("window event (change: %s, id: %lu)\n", e->change, id);
 
-        i3ipc_rect_free(parent_rect);
-        g_object_unref(parent);
+    if (record_enabled())
+    {
+        gchar *name = NULL;
+        g_object_get(e->container, "name", &name, NULL);
+        record_i3_event("window", e->change, id, urgent, name);
+        g_free(name);
     }
 
-    i3ipc_rect_free(deco_rect);
-
-    LOG("found window (id: %lu, window: %u, x: %i, y: %i)\n", id, win_id, x, y);
-    Window *window = malloc(sizeof(Window));
-    window->id = id;
-    window->win_id = win_id;
-    window->position.x = x;
-    window->position.y = y;
-    window->next = NULL;
-    if (urgent) {
-        window->type = URGENT_WINDOW;
-    } else if (focused) {
-        window->type = FOCUSED_WINDOW;
-    } else {
-        window->type = UNFOCUSED_WINDOW;
+    if (strcmp(e->change, "focus") == 0)
+    {
+        push_event(IPC_EVENT_FOCUS, id, urgent);
+        tree_stale |= (tree == NULL || tree_focus(tree, id));
     }
-
-    return window;
-}
-
-static unsigned long con_get_focused_id(i3ipcCon *con)
-{
-    GList *focus_stack = NULL;
-    g_object_get(con, "focus", &focus_stack, NULL);
-    if (focus_stack == NULL)
+    else if (strcmp(e->change, "urgent") == 0)
     {
-        LOG("empty focus stack in con\n");
-        return 0;
+        push_event(IPC_EVENT_URGENT, id, urgent);
+        tree_stale |= (tree == NULL || tree_set_urgent(tree, id, urgent));
+    }
+    else if (strcmp(e->change, "title") == 0)
+    {
+        gchar *name = NULL;
+        g_object_get(e->container, "name", &name, NULL);
+        tree_stale |= (tree == NULL || tree_set_name(tree, id, name));
+        g_free(name);
+    }
+    else if (strcmp(e->change, "mark") != 0)
+    {
+        // i3 doesn't report how new, closed or moved windows affect the
+        // geometry of the others
+        push_event(strcmp(e->change, "close") == 0 ? IPC_EVENT_CLOSE : IPC_EVENT_LAYOUT, id, urgent);
+        tree_stale = 1;
     }
-
-    unsigned long focus_id = (unsigned long) focus_stack->data;
-
-    return focus_id;
 }
 
-static i3ipcCon *con_get_visible_container(i3ipcCon *con)
+static void on_workspace_event(i3ipcConnection *conn, i3ipcWorkspaceEvent *e, gpointer data)
 {
-    unsigned long id;
-    g_object_get(con, "id", &id, NULL);
-    LOG("find visible container in con '%lu'\n", id);
+    (void) conn;
+    (void) data;
 
-    GList *descendants = i3ipc_con_descendents(con);
+    LOG("workspace event (change: %s)\n", e->change);
 
-    i3ipcCon *target = con;
-    GList *elem = NULL;
-    i3ipcCon *curr = NULL;
-    for (elem = descendants; elem; elem = elem->next)
+    unsigned long id = 0;
+    gboolean urgent = FALSE;
+    gchar *name = NULL;
+    if (e->current != NULL)
     {
-        curr = elem->data;
-        gboolean fullscreen;
-        g_object_get(curr, "fullscreen-mode", &fullscreen, NULL);
-        if (fullscreen)
-        {
-            LOG("con is in fullscreen mode\n");
-            target = curr;
-            break;
-        }
+        g_object_get(e->current, "id", &id, "urgent", &urgent, "name", &name, NULL);
     }
+    record_i3_event("workspace", e->change, id, urgent, name);
 
-    g_list_free(descendants);
-
-    return target;
-}
-
-static Window *visible_windows(i3ipcCon *root)
-{
-    GList *nodes = g_list_copy((GList *) i3ipc_con_get_nodes(root));
-    GList *floating = g_list_copy((GList *) i3ipc_con_get_floating_nodes(root));
-    nodes = g_list_concat(nodes, floating);
-    if (nodes == NULL)
+    // urgency and names of workspaces don't move any window, so the labels stay
+    if (strcmp(e->change, "urgent") == 0 && e->current != NULL)
     {
-        return con_to_window(root);
+        tree_stale |= (tree == NULL || tree_set_urgent(tree, id, urgent));
     }
-
-    gchar *layout = NULL;
-    g_object_get(root, "layout", &layout, NULL);
-
-    Window *res = NULL;
-    const GList *elem;
-    if ((strcmp(layout, "tabbed") == 0) ||
-        (strcmp(layout, "stacked") == 0))
+    else if (strcmp(e->change, "rename") == 0 && e->current != NULL)
     {
-        unsigned long focus_id = con_get_focused_id(root);
-        for (elem = nodes; elem; elem = elem->next)
-        {
-            i3ipcCon *curr = elem->data;
-            unsigned long id;
-            g_object_get(curr, "id", &id, NULL);
-            Window *win = NULL;
-            if (id == focus_id)
-            {
-                win = visible_windows(curr);
-                if (win->id != id)
-                {
-                    res = window_append(res, con_to_window(curr));
-                }
-            }
-            else
-            {
-                win = con_to_window(curr);
-            }
-
-            res = window_append(res, win);
-        }
+        tree_stale |= (tree == NULL || tree_set_name(tree, id, name));
     }
-    else if ((strcmp(layout, "splith") == 0) ||
-             (strcmp(layout, "splitv") == 0))
+    else if (strcmp(e->change, "focus") == 0 && e->current != NULL)
     {
-        for (elem = nodes; elem; elem = elem->next)
-        {
-            i3ipcCon *curr = elem->data;
-            res = window_append(res, visible_windows(curr));
-        }
+        push_event(IPC_EVENT_LAYOUT, 0, 0);
+        tree_stale |= (tree == NULL || tree_focus_workspace(tree, id));
+    }
+    else if (strcmp(e->change, "init") == 0 ||
+             strcmp(e->change, "empty") == 0 ||
+             strcmp(e->change, "move") == 0 ||
+             strcmp(e->change, "reload") == 0)
+    {
+        // these change which windows are visible
+        push_event(IPC_EVENT_LAYOUT, 0, 0);
+        tree_stale = 1;
     }
     else
     {
-        LOG("unknown layout of con: %s\n", layout);
+        // e.g. restored, the windows stay where they are but the tree may differ
+        tree_stale = 1;
     }
 
-    g_free(layout);
-    g_list_free(nodes);
+    g_free(name);
+}
+
+static void on_output_event(i3ipcConnection *conn, i3ipcGenericEvent *e, gpointer data)
+{
+    (void) conn;
+    (void) data;
+
+    LOG("output event (change: %s)\n", e->change);
+    record_i3_event("output", e->change, 0, 0, NULL);
+    push_event(IPC_EVENT_LAYOUT, 0, 0);
+    tree_stale = 1;
+}
+
+static void on_ipc_shutdown(i3ipcConnection *conn, gpointer data)
+{
+    (void) conn;
+    (void) data;
 
-    return res;
+    // events may have been lost, e.g., while i3 restarts
+    LOG("ipc shutdown\n");
+    push_event(IPC_EVENT_LAYOUT, 0, 0);
+    tree_stale = 1;
 }
 
-static Window *visible_windows_on_curr_output(i3ipcCon *root)
+static Tree *fetch_tree()
 {
-    i3ipcCon *focused = i3ipc_con_find_focused(root);
-    if (focused == NULL)
+    trace_begin(TRACE_GET_TREE);
+    GError *err = NULL;
+    long long start_ns = record_now();
+    gchar *reply = i3ipc_connection_message(connection, I3IPC_MESSAGE_TYPE_GET_TREE, "", &err);
+    trace_ipc_message();
+    if (err != NULL)
     {
-        LOG("cannot find focused window\n");
+        LOG("error getting tree: %s\n", err->message);
+        g_error_free(err);
+        trace_end(TRACE_GET_TREE);
         return NULL;
     }
+    record_ipc("get_tree", "", reply, start_ns);
 
-    i3ipcCon *ws = i3ipc_con_workspace(focused);
-    ws = (ws == NULL ? focused : ws);
-
-    i3ipcCon *con = con_get_visible_container(ws);
-    return visible_windows(con);
-}
+    Tree *fetched = tree_parse(reply);
+    g_free(reply);
+    trace_end(TRACE_GET_TREE);
 
-static gint compare_rects(i3ipcRect *a, i3ipcRect *b)
-{
-    return a->y == b->y ? a->x - b->x : a->y - b->y;
+    return fetched;
 }
 
-static gint compare_workspace_position(gconstpointer a, gconstpointer b, gpointer outputs_)
+int ipc_refresh_tree()
 {
-    const i3ipcWorkspaceReply *reply_a = (i3ipcWorkspaceReply *) a;
-    const i3ipcWorkspaceReply *reply_b = (i3ipcWorkspaceReply *) b;
-
-    if (g_str_equal(reply_a->output, reply_b->output))
+    if (!tree_stale)
+    {
+        LOG("tree is up to date\n");
         return 0;
+    }
 
-    i3ipcRect *rect_a = NULL;
-    i3ipcRect *rect_b = NULL;
-    GSList *outputs = (GSList *) outputs_;
-    const GSList *output_reply;
-    for (output_reply = outputs; output_reply; output_reply = output_reply->next)
+    tree_free(tree);
+    tree = fetch_tree();
+    if (tree == NULL)
     {
-        i3ipcOutputReply *output = output_reply->data;
+        LOG("error getting tree\n");
+        return 1;
+    }
+    tree_stale = 0;
 
-        if (g_str_equal(output->name, reply_a->output))
-            rect_a = output->rect;
-        else if (g_str_equal(output->name, reply_b->output))
-            rect_b = output->rect;
+    return 0;
+}
 
-        if (rect_a && rect_b)
-            break;
-    }
-    if (!rect_a || !rect_b)
+Window *ipc_visible_windows(SearchArea search_area, SortMethod sort_method, const Criteria *criteria, LabelOrder order)
+{
+    if (ipc_refresh_tree())
     {
-        const i3ipcWorkspaceReply *unassigned_workspace = rect_a ? reply_a : reply_b;
-        LOG("output %s for workspace %s not found\n", unassigned_workspace->output, unassigned_workspace->name);
-        return 0;
+        return NULL;
     }
-    return compare_rects(rect_a, rect_b);
-}
 
-static gint compare_workspace_nums(gconstpointer a, gconstpointer b)
-{
-    const i3ipcWorkspaceReply *reply_a = (i3ipcWorkspaceReply *) a;
-    const i3ipcWorkspaceReply *reply_b = (i3ipcWorkspaceReply *) b;
+    trace_begin(TRACE_VISIBILITY);
+    PROBE2(walk_entry, search_area, g_hash_table_size(tree->index));
+    Window *windows = walk_visible_windows(tree, search_area, sort_method, criteria, order);
+    PROBE1(walk_exit, PROBE_ENABLED(walk_exit) ? window_count(windows) : 0);
+    trace_end(TRACE_VISIBILITY);
 
-    return reply_a->num - reply_b->num;
+    return windows;
 }
 
-static Window *visible_windows_on_all_outputs(i3ipcCon *root, SortMethod sort_method)
+void ipc_invalidate()
 {
-    GSList *raw_replies = i3ipc_connection_get_workspaces(connection, NULL);
-    GSList *replies = g_slist_reverse(raw_replies); // i3ipc-glib reverses the order internally
-
-    if (sort_method == BY_NUMBER)
-    {
-        replies = g_slist_sort(replies, compare_workspace_nums);
-    }
-    else if (sort_method == BY_LOCATION)
-    {
-        GSList *outputs = i3ipc_connection_get_outputs(connection, NULL);
-        replies = g_slist_sort_with_data(replies, compare_workspace_position, outputs);
-        g_slist_free_full(outputs, (GDestroyNotify) i3ipc_output_reply_free);
-    }
+    tree_stale = 1;
+}
 
-    GList *workspaces = i3ipc_con_workspaces(root);
+/*
+ * Replaces %con_id and %window_id in the template with the ids of the
+ * window, other text is sent to i3 as is.
+ */
+static gchar *expand_command(const char *template, Window *window)
+{
+    static const char con_id[] = "%con_id";
+    static const char window_id[] = "%window_id";
 
-    Window *res = NULL;
-    const GSList *reply;
-    i3ipcWorkspaceReply *curr_reply;
-    for (reply = replies; reply; reply = reply->next)
+    GString *cmd = g_string_sized_new(strlen(template) + 16);
+    const char *p = template;
+    while (*p != '\0')
     {
-        curr_reply = reply->data;
-        if (!curr_reply->visible)
-            continue;
-
-        const GList *ws;
-        i3ipcCon *curr_ws;
-        for (ws = workspaces; ws; ws = ws->next)
+        if (strncmp(p, con_id, sizeof(con_id) - 1) == 0)
+        {
+            g_string_append_printf(cmd, "%lu", window->id);
+            p += sizeof(con_id) - 1;
+        }
+        else if (strncmp(p, window_id, sizeof(window_id) - 1) == 0)
+        {
+            g_string_append_printf(cmd, "%u", window->win_id);
+            p += sizeof(window_id) - 1;
+        }
+        else
         {
-            curr_ws = ws->data;
-            const char *name = i3ipc_con_get_name(curr_ws);
-            if (strcmp(curr_reply->name, name) == 0)
-            {
-                i3ipcCon *con = con_get_visible_container(curr_ws);
-                res = window_append(res, visible_windows(con));
-                break;
-            }
+            g_string_append_c(cmd, *p++);
         }
     }
 
-    g_slist_free_full(replies, (GDestroyNotify) i3ipc_workspace_reply_free);
-    g_list_free(workspaces);
-
-    return res;
+    return g_string_free(cmd, FALSE);
 }
 
-static Window *visible_windows_in_curr_con(i3ipcCon *root)
+// i3's replies are parsed already, so only their outcome can be recorded
+static void record_command(const char *cmd, GSList *replies, long long start_ns)
 {
-    i3ipcCon *focused = i3ipc_con_find_focused(root);
-    if (focused == NULL)
+    GString *json = g_string_new("[");
+    GSList *curr;
+    for (curr = replies; curr != NULL; curr = curr->next)
     {
-        LOG("cannot find focused window\n");
-        return NULL;
+        i3ipcCommandReply *reply = curr->data;
+        g_string_append_printf(json, "%s{\"success\":%s}", curr == replies ? "" : ",", reply->success ? "true" : "false");
     }
+    g_string_append_c(json, ']');
 
-    i3ipcCon *parent;
-    g_object_get(focused, "parent", &parent, NULL);
-    i3ipcCon *con = con_get_visible_container(parent);
-    g_object_unref(parent);
-
-    return visible_windows(con);
+    record_ipc("command", cmd, json->str, start_ns);
+    g_string_free(json, TRUE);
 }
 
-Window *ipc_visible_windows(SearchArea search_area, SortMethod sort_method)
+int ipc_exec_window(Window *window, const char *template)
 {
-    i3ipcCon *root = i3ipc_connection_get_tree(connection, NULL);
-    if (root == NULL)
+    gchar *cmd = expand_command(template, window);
+    LOG("sending command (id: %lu): %s\n", window->id, cmd);
+    GError *err = NULL;
+    long long start_ns = record_now();
+    GSList *replies = i3ipc_connection_command(connection, cmd, &err);
+    trace_ipc_message();
+    if (record_enabled())
     {
-        LOG("error getting tree\n");
-        return NULL;
+        record_command(cmd, replies, start_ns);
     }
-
-    Window *windows = NULL;
-    switch (search_area)
+    g_free(cmd);
+    if (err != NULL || replies == NULL)
     {
-    case CURRENT_OUTPUT:
-        windows = visible_windows_on_curr_output(root);
-        break;
-    case ALL_OUTPUTS:
-        windows = visible_windows_on_all_outputs(root, sort_method);
-        break;
-    case CURRENT_CONTAINER:
-        windows = visible_windows_in_curr_con(root);
-        break;
+        LOG("error sending command: %s\n", err != NULL ? err->message : "no reply");
+        if (err != NULL)
+        {
+            g_error_free(err);
+        }
+        g_slist_free_full(replies, (GDestroyNotify) i3ipc_command_reply_free);
+        return 1;
     }
 
-    g_object_unref(root);
+    // commands separated by ';' are answered one by one
+    int failed = 0;
+    GSList *curr;
+    for (curr = replies; curr != NULL; curr = curr->next)
+    {
+        i3ipcCommandReply *reply = curr->data;
+        if (!reply->success)
+        {
+            LOG("command returned error: %s\n", reply->error);
+            failed = 1;
+        }
+    }
 
-    return windows;
+    g_slist_free_full(replies, (GDestroyNotify) i3ipc_command_reply_free);
+    return failed;
 }
 
 int ipc_focus_window(Window *window)
 {
     LOG("focusing window (id: %lu)\n", window->id);
-    char *cmd = malloc(BUFFER);
-    snprintf(cmd, BUFFER - 1, "[ con_id=%lu ] focus", window->id);
-    GSList *replies = i3ipc_connection_command(connection, cmd, NULL);
-    free(cmd);
-
-    i3ipcCommandReply *reply = replies->data;
-    if (!reply->success)
+    PROBE2(focus_send, window->id, window->win_id);
+    int failed = ipc_exec_window(window, IPC_FOCUS_COMMAND);
+    PROBE2(focus_reply, window->id, failed);
+    if (failed)
     {
-        LOG("focus command returned error: %s\n", reply->error);
-        g_slist_free_full(replies, (GDestroyNotify) i3ipc_command_reply_free);
         return 1;
     }
 
-    g_slist_free_full(replies, (GDestroyNotify) i3ipc_command_reply_free);
+    // don't rely on the focus event arriving before the next walk
+    tree_stale |= (tree == NULL || tree_focus(tree, window->id));
 
     return 0;
 }
@@ -359,7 +326,8 @@ int ipc_focus_window(Window *window)
 int ipc_init()
 {
     GError *err = NULL;
-    connection = i3ipc_connection_new(NULL, &err);
+    // like i3-msg, I3SOCK overrides the socket i3 announces on the root window
+    connection = i3ipc_connection_new(getenv("I3SOCK"), &err);
     if (err != NULL)
     {
         LOG("error connecting: %s\n", err->message);
@@ -370,8 +338,70 @@ int ipc_init()
     return 0;
 }
 
+int ipc_subscribe()
+{
+    GError *err = NULL;
+    long long start_ns = record_now();
+    i3ipcCommandReply *reply = i3ipc_connection_subscribe(connection, I3IPC_EVENT_WINDOW | I3IPC_EVENT_WORKSPACE | I3IPC_EVENT_OUTPUT, &err);
+    trace_ipc_message();
+    if (err != NULL)
+    {
+        LOG("error subscribing to events: %s\n", err->message);
+        g_error_free(err);
+        return 1;
+    }
+
+    int success = reply->success;
+    record_ipc("subscribe", "[\"window\",\"workspace\",\"output\"]", success ? "{\"success\":true}" : "{\"success\":false}", start_ns);
+    i3ipc_command_reply_free(reply);
+    if (!success)
+    {
+        LOG("subscribing to events failed\n");
+        return 1;
+    }
+
+    g_signal_connect(connection, "window", G_CALLBACK(on_window_event), NULL);
+    g_signal_connect(connection, "workspace", G_CALLBACK(on_workspace_event), NULL);
+    g_signal_connect(connection, "output", G_CALLBACK(on_output_event), NULL);
+    g_signal_connect(connection, "ipc_shutdown", G_CALLBACK(on_ipc_shutdown), NULL);
+
+    return 0;
+}
+
+IpcEvent *ipc_poll_events()
+{
+    // i3ipc-glib dispatches events from the default main context
+    while (g_main_context_iteration(NULL, FALSE))
+    {
+    }
+
+    IpcEvent *events = events_head;
+    events_head = NULL;
+    events_tail = NULL;
+
+    return events;
+}
+
+void ipc_event_free(IpcEvent *event)
+{
+    while (event != NULL)
+    {
+        IpcEvent *tmp = event;
+        event = event->next;
+        free(tmp);
+    }
+}
+
 void ipc_finish()
 {
+    ipc_event_free(events_head);
+    events_head = NULL;
+    events_tail = NULL;
+
+    tree_free(tree);
+    tree = NULL;
+    tree_stale = 1;
+
     g_object_unref(connection);
     connection = NULL;
 }
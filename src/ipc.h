@@ -3,10 +3,15 @@
 
 #include "win.h"
 
+#include <regex.h>
+
+#define IPC_FOCUS_COMMAND "[con_id=%con_id] focus"
+
 typedef enum {
     CURRENT_OUTPUT,
     ALL_OUTPUTS,
-    CURRENT_CONTAINER
+    CURRENT_CONTAINER,
+    EVERYWHERE
 } SearchArea;
 
 typedef enum {
@@ -14,8 +19,44 @@ typedef enum {
     BY_NUMBER
 } SortMethod;
 
+typedef enum {
+    ORDER_TREE,
+    ORDER_PROXIMITY
+} LabelOrder;
+
+// windows that don't match are skipped during the walk, unset fields match all
+typedef struct criteria
+{
+    regex_t *class_name;
+    regex_t *instance;
+    regex_t *title;
+    int tiling;
+    int floating;
+} Criteria;
+
+typedef enum {
+    IPC_EVENT_FOCUS,
+    IPC_EVENT_URGENT,
+    IPC_EVENT_CLOSE,
+    IPC_EVENT_LAYOUT
+} IpcEventType;
+
+typedef struct ipc_event
+{
+    struct ipc_event *next;
+    IpcEventType type;
+    unsigned long id;
+    int urgent;
+} IpcEvent;
+
 int ipc_init();
-Window *ipc_visible_windows(SearchArea search_area, SortMethod sort_method);
+int ipc_subscribe();
+IpcEvent *ipc_poll_events();
+void ipc_event_free(IpcEvent *event);
+int ipc_refresh_tree();
+Window *ipc_visible_windows(SearchArea search_area, SortMethod sort_method, const Criteria *criteria, LabelOrder order);
+void ipc_invalidate();
+int ipc_exec_window(Window *window, const char *template);
 int ipc_focus_window(Window *window);
 void ipc_finish();
 
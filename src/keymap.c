@@ -0,0 +1,595 @@
+#include "keymap.h"
+#include "util.h"
+#include "trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <xcb/xkb.h>
+
+/*
+ * Resolves keycodes and keysyms the way XKB does. With XKB, the key types and
+ * symbols come from its map: every key has its own number of groups, a rule
+ * for groups beyond them, and per group a key type that maps the modifiers
+ * to a shift level. Without XKB, the core keyboard mapping is used like the
+ * core protocol does, with the unshifted and shifted keysym in the first two
+ * columns. Only the core mapping is cached, the XKB map arrives in the same
+ * round trip as the XKB state anyway.
+ */
+
+#define KEYMAP_MAX_GROUPS 4
+#define GROUP_INFO_COUNT_MASK 0x0f
+#define GROUP_INFO_REDIRECT_MASK 0x30
+#define GROUP_INFO_RANGE_MASK 0xc0
+
+typedef struct level_entry
+{
+    uint8_t mods;
+    uint8_t level;
+} LevelEntry;
+
+typedef struct key_type
+{
+    uint8_t mods_mask;
+    size_t num_entries;
+    LevelEntry *entries; // the active ones of the type's map
+} KeyType;
+
+typedef struct key
+{
+    uint8_t num_groups;
+    uint8_t group_info; // how groups out of range are brought back
+    uint8_t width;      // levels per group
+    uint8_t types[KEYMAP_MAX_GROUPS];
+    size_t first_sym;
+} Key;
+
+static xcb_connection_t *connection = NULL;
+static xcb_keycode_t min_keycode = 0;
+static xcb_keycode_t max_keycode = 0;
+
+// the core keyboard mapping, used without XKB
+static uint8_t keysyms_per_keycode = 0;
+static xcb_keysym_t *table = NULL;
+
+// a mapping taken from the cache is checked against the server's later
+static int mapping_pending = 0;
+static xcb_get_keyboard_mapping_cookie_t pending_cookie;
+
+// the XKB map, keys are indexed by keycode - min_keycode
+static KeyType *xkb_types = NULL;
+static size_t num_xkb_types = 0;
+static Key *xkb_keys = NULL;
+static xcb_keysym_t *xkb_syms = NULL;
+
+static int xkb_available = 0;
+static uint8_t xkb_event_base = 0;
+static uint8_t active_group = 0;
+
+static void discard_pending_mapping()
+{
+    if (mapping_pending)
+    {
+        xcb_discard_reply(connection, pending_cookie.sequence);
+        mapping_pending = 0;
+    }
+}
+
+static int load_keyboard_mapping(xcb_keycode_t first, int count)
+{
+    if (mapping_pending)
+    {
+        // the cached table may be outdated, so only a full update fits
+        discard_pending_mapping();
+        first = min_keycode;
+        count = max_keycode - min_keycode + 1;
+    }
+
+    LOG("load keyboard mapping (first: %i, count: %i)\n", first, count);
+    xcb_get_keyboard_mapping_cookie_t cookie = xcb_get_keyboard_mapping(connection, first, count);
+    xcb_get_keyboard_mapping_reply_t *reply = xcb_get_keyboard_mapping_reply(connection, cookie, NULL);
+    trace_x_round_trip();
+    if (reply == NULL)
+    {
+        LOG("cannot get keyboard mapping\n");
+        return 1;
+    }
+
+    int full = (first == min_keycode && count == max_keycode - min_keycode + 1);
+    if (!full && reply->keysyms_per_keycode != keysyms_per_keycode)
+    {
+        // the layout of the table changed, so the partial update doesn't fit
+        free(reply);
+        return load_keyboard_mapping(min_keycode, max_keycode - min_keycode + 1);
+    }
+
+    if (full)
+    {
+        xcb_keysym_t *resized = realloc(table, (size_t) count * reply->keysyms_per_keycode * sizeof(xcb_keysym_t));
+        if (resized == NULL)
+        {
+            LOG("cannot allocate keysym table\n");
+            free(reply);
+            return 1;
+        }
+
+        table = resized;
+        keysyms_per_keycode = reply->keysyms_per_keycode;
+    }
+
+    memcpy(table + (size_t) (first - min_keycode) * keysyms_per_keycode,
+           xcb_get_keyboard_mapping_keysyms(reply),
+           (size_t) count * keysyms_per_keycode * sizeof(xcb_keysym_t));
+
+    free(reply);
+    return 0;
+}
+
+static int load_full_keyboard_mapping()
+{
+    return load_keyboard_mapping(min_keycode, max_keycode - min_keycode + 1);
+}
+
+static void free_key_types(KeyType *types, size_t count)
+{
+    size_t i;
+    for (i = 0; types != NULL && i < count; i++)
+    {
+        free(types[i].entries);
+    }
+
+    free(types);
+}
+
+static void free_xkb_map()
+{
+    free_key_types(xkb_types, num_xkb_types);
+    free(xkb_keys);
+    free(xkb_syms);
+    xkb_types = NULL;
+    num_xkb_types = 0;
+    xkb_keys = NULL;
+    xkb_syms = NULL;
+}
+
+static xcb_xkb_get_map_cookie_t request_xkb_map()
+{
+    return xcb_xkb_get_map(connection, XCB_XKB_ID_USE_CORE_KBD,
+                           XCB_XKB_MAP_PART_KEY_TYPES | XCB_XKB_MAP_PART_KEY_SYMS,
+                           0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+}
+
+static int read_xkb_types(const xcb_xkb_get_map_reply_t *reply, const xcb_xkb_get_map_map_t *map, KeyType *types)
+{
+    xcb_xkb_key_type_iterator_t type = xcb_xkb_get_map_map_types_rtrn_iterator(reply, map);
+    size_t i;
+    for (i = 0; type.rem > 0 && i < reply->nTypes; xcb_xkb_key_type_next(&type), i++)
+    {
+        xcb_xkb_kt_map_entry_t *entries = xcb_xkb_key_type_map(type.data);
+        int length = xcb_xkb_key_type_map_length(type.data);
+
+        types[i].mods_mask = type.data->mods_mask;
+        types[i].entries = malloc(sizeof(LevelEntry) * (length + 1));
+        if (types[i].entries == NULL)
+        {
+            return 1;
+        }
+
+        int e;
+        for (e = 0; e < length; e++)
+        {
+            if (entries[e].active)
+            {
+                LevelEntry *entry = &types[i].entries[types[i].num_entries++];
+                entry->mods = entries[e].mods_mask;
+                entry->level = entries[e].level;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int read_xkb_keys(const xcb_xkb_get_map_reply_t *reply, const xcb_xkb_get_map_map_t *map, Key *keys, xcb_keysym_t *syms)
+{
+    size_t num_keys = (size_t) (reply->maxKeyCode - reply->minKeyCode + 1);
+    size_t next_sym = 0;
+    size_t k = (size_t) (reply->firstKeySym - reply->minKeyCode);
+    xcb_xkb_key_sym_map_iterator_t sym_map = xcb_xkb_get_map_map_syms_rtrn_iterator(reply, map);
+    for (; sym_map.rem > 0 && k < num_keys; xcb_xkb_key_sym_map_next(&sym_map), k++)
+    {
+        int length = xcb_xkb_key_sym_map_syms_length(sym_map.data);
+        if (next_sym + length > reply->totalSyms)
+        {
+            return 1;
+        }
+
+        Key *key = &keys[k];
+        key->num_groups = sym_map.data->groupInfo & GROUP_INFO_COUNT_MASK;
+        key->group_info = sym_map.data->groupInfo & ~GROUP_INFO_COUNT_MASK;
+        key->width = sym_map.data->width;
+        key->first_sym = next_sym;
+        if (key->num_groups > KEYMAP_MAX_GROUPS || (size_t) key->num_groups * key->width > (size_t) length)
+        {
+            LOG("ignoring malformed key (keycode: %lu)\n", (unsigned long) (k + reply->minKeyCode));
+            key->num_groups = 0;
+        }
+
+        int g;
+        for (g = 0; g < KEYMAP_MAX_GROUPS; g++)
+        {
+            uint8_t type = sym_map.data->kt_index[g];
+            key->types[g] = type < reply->nTypes ? type : 0;
+        }
+
+        memcpy(syms + next_sym, xcb_xkb_key_sym_map_syms(sym_map.data), length * sizeof(xcb_keysym_t));
+        next_sym += length;
+    }
+
+    return 0;
+}
+
+// the previous map stays in use if the new one cannot be read
+static int load_xkb_map(xcb_xkb_get_map_reply_t *reply)
+{
+    xcb_xkb_get_map_map_t map;
+    xcb_xkb_get_map_map_unpack(xcb_xkb_get_map_map(reply),
+                               reply->nTypes, reply->nKeySyms, reply->nKeyActions, reply->totalActions,
+                               reply->totalKeyBehaviors, reply->virtualMods, reply->totalKeyExplicit,
+                               reply->totalModMapKeys, reply->totalVModMapKeys, reply->present, &map);
+
+    size_t num_keys = reply->maxKeyCode >= reply->minKeyCode ? (size_t) (reply->maxKeyCode - reply->minKeyCode + 1) : 0;
+    KeyType *types = calloc(reply->nTypes + 1, sizeof(KeyType));
+    Key *keys = calloc(num_keys + 1, sizeof(Key));
+    xcb_keysym_t *syms = malloc(sizeof(xcb_keysym_t) * (reply->totalSyms + 1));
+    int failed = (types == NULL || keys == NULL || syms == NULL || num_keys == 0 ||
+                  reply->firstKeySym < reply->minKeyCode ||
+                  read_xkb_types(reply, &map, types) ||
+                  read_xkb_keys(reply, &map, keys, syms));
+    if (failed)
+    {
+        LOG("cannot read xkb map\n");
+        free_key_types(types, reply->nTypes);
+        free(keys);
+        free(syms);
+        return 1;
+    }
+
+    free_xkb_map();
+    xkb_types = types;
+    num_xkb_types = reply->nTypes;
+    xkb_keys = keys;
+    xkb_syms = syms;
+    min_keycode = reply->minKeyCode;
+    max_keycode = reply->maxKeyCode;
+    LOG("loaded xkb map (keycodes: %i to %i, types: %lu)\n", min_keycode, max_keycode, num_xkb_types);
+    return 0;
+}
+
+static int reload_xkb_map()
+{
+    xcb_xkb_get_map_reply_t *reply = xcb_xkb_get_map_reply(connection, request_xkb_map(), NULL);
+    trace_x_round_trip();
+    if (reply == NULL)
+    {
+        LOG("cannot get xkb map\n");
+        return 1;
+    }
+
+    int failed = load_xkb_map(reply);
+    free(reply);
+    return failed;
+}
+
+/*
+ * The map is requested together with the state, so that XKB costs a single
+ * round trip once the extension is known.
+ */
+static int init_xkb()
+{
+    const xcb_query_extension_reply_t *ext = xcb_get_extension_data(connection, &xcb_xkb_id);
+    trace_x_round_trip();
+    if (ext == NULL || !ext->present)
+    {
+        LOG("xkb extension not available\n");
+        return 1;
+    }
+
+    xcb_xkb_use_extension_cookie_t use_cookie = xcb_xkb_use_extension(connection, XCB_XKB_MAJOR_VERSION, XCB_XKB_MINOR_VERSION);
+    xcb_xkb_get_state_cookie_t state_cookie = xcb_xkb_get_state(connection, XCB_XKB_ID_USE_CORE_KBD);
+    xcb_xkb_get_map_cookie_t map_cookie = request_xkb_map();
+
+    xcb_xkb_use_extension_reply_t *use_reply = xcb_xkb_use_extension_reply(connection, use_cookie, NULL);
+    xcb_xkb_get_state_reply_t *state_reply = xcb_xkb_get_state_reply(connection, state_cookie, NULL);
+    xcb_xkb_get_map_reply_t *map_reply = xcb_xkb_get_map_reply(connection, map_cookie, NULL);
+    trace_x_round_trip();
+    int failed = (use_reply == NULL || !use_reply->supported || state_reply == NULL || map_reply == NULL ||
+                  load_xkb_map(map_reply));
+    if (!failed)
+    {
+        active_group = state_reply->group;
+    }
+
+    free(use_reply);
+    free(state_reply);
+    free(map_reply);
+    if (failed)
+    {
+        LOG("cannot use xkb extension\n");
+        return 1;
+    }
+
+    uint16_t events = XCB_XKB_EVENT_TYPE_NEW_KEYBOARD_NOTIFY | XCB_XKB_EVENT_TYPE_MAP_NOTIFY | XCB_XKB_EVENT_TYPE_STATE_NOTIFY;
+    xcb_xkb_select_events(connection, XCB_XKB_ID_USE_CORE_KBD, events, 0, events, 0xff, 0xff, NULL);
+
+    xkb_event_base = ext->first_event;
+    xkb_available = 1;
+    LOG("using xkb (active group: %i)\n", active_group);
+    return 0;
+}
+
+static int use_cached_mapping(const Cache *cache)
+{
+    if (cache == NULL || cache->keysyms == NULL ||
+        cache->min_keycode != min_keycode || cache->max_keycode != max_keycode)
+    {
+        return 1;
+    }
+
+    size_t count = (size_t) (max_keycode - min_keycode + 1) * cache->keysyms_per_keycode;
+    table = malloc(count * sizeof(xcb_keysym_t));
+    if (table == NULL)
+    {
+        return 1;
+    }
+
+    memcpy(table, cache->keysyms, count * sizeof(xcb_keysym_t));
+    keysyms_per_keycode = cache->keysyms_per_keycode;
+
+    pending_cookie = xcb_get_keyboard_mapping(connection, min_keycode, max_keycode - min_keycode + 1);
+    mapping_pending = 1;
+    LOG("using cached keyboard mapping\n");
+    return 0;
+}
+
+int keymap_init(xcb_connection_t *conn, const Cache *cache)
+{
+    connection = conn;
+    min_keycode = xcb_get_setup(connection)->min_keycode;
+    max_keycode = xcb_get_setup(connection)->max_keycode;
+
+    if (init_xkb() == 0)
+    {
+        return 0;
+    }
+
+    // without xkb, only the first group can be used, like the core protocol does
+    free_xkb_map();
+    xkb_available = 0;
+    active_group = 0;
+    return use_cached_mapping(cache) && load_full_keyboard_mapping();
+}
+
+/*
+ * Brings a group beyond the ones the key has back into range, following the
+ * key's wrap, clamp or redirect rule.
+ */
+static uint8_t key_group(const Key *key, uint8_t group)
+{
+    if (group < key->num_groups)
+    {
+        return group;
+    }
+
+    switch (key->group_info & GROUP_INFO_RANGE_MASK)
+    {
+    case XCB_XKB_GROUPS_WRAP_CLAMP_INTO_RANGE:
+        return key->num_groups - 1;
+    case XCB_XKB_GROUPS_WRAP_REDIRECT_INTO_RANGE:
+    {
+        uint8_t redirect = (key->group_info & GROUP_INFO_REDIRECT_MASK) >> 4;
+        return redirect < key->num_groups ? redirect : 0;
+    }
+    default:
+        return group % key->num_groups;
+    }
+}
+
+static uint8_t key_level(const Key *key, uint8_t group, uint16_t state)
+{
+    const KeyType *type = &xkb_types[key->types[group]];
+    uint8_t mods = state & type->mods_mask;
+    size_t i;
+    for (i = 0; i < type->num_entries; i++)
+    {
+        if (type->entries[i].mods == mods)
+        {
+            return type->entries[i].level;
+        }
+    }
+
+    return 0;
+}
+
+static xcb_keysym_t xkb_keysym(xcb_keycode_t keycode, uint8_t group, uint16_t state)
+{
+    const Key *key = &xkb_keys[keycode - min_keycode];
+    if (key->num_groups == 0)
+    {
+        return XCB_NO_SYMBOL;
+    }
+
+    group = key_group(key, group);
+    uint8_t level = key_level(key, group, state);
+    if (level >= key->width)
+    {
+        return XCB_NO_SYMBOL;
+    }
+
+    return xkb_syms[key->first_sym + (size_t) group * key->width + level];
+}
+
+/*
+ * The core protocol only knows the first group here, with Shift or Lock
+ * selecting the second column if the key has one.
+ */
+static xcb_keysym_t core_keysym(xcb_keycode_t keycode, uint16_t state)
+{
+    xcb_keysym_t *syms = table + (size_t) (keycode - min_keycode) * keysyms_per_keycode;
+    int shifted = (state & (XCB_MOD_MASK_SHIFT | XCB_MOD_MASK_LOCK)) != 0;
+    if (shifted && keysyms_per_keycode > 1 && syms[1] != XCB_NO_SYMBOL)
+    {
+        return syms[1];
+    }
+
+    return keysyms_per_keycode > 0 ? syms[0] : XCB_NO_SYMBOL;
+}
+
+int keymap_keycodes(xcb_keysym_t keysym, xcb_keycode_t *keycodes, int max_keycodes)
+{
+    // labels are grabbed on the key that types them without modifiers
+    int count = 0;
+    int i;
+    for (i = min_keycode; i <= max_keycode && count < max_keycodes; i++)
+    {
+        xcb_keysym_t sym = xkb_available ? xkb_keysym(i, active_group, 0) : core_keysym(i, 0);
+        if (sym == keysym)
+        {
+            keycodes[count++] = i;
+        }
+    }
+
+    return count;
+}
+
+xcb_keysym_t keymap_lookup(xcb_keycode_t keycode, uint16_t state)
+{
+    if (keycode < min_keycode || keycode > max_keycode)
+    {
+        return XCB_NO_SYMBOL;
+    }
+
+    if (!xkb_available)
+    {
+        return core_keysym(keycode, state);
+    }
+
+    // xkb reports the group of the key event in bits 13 and 14 of the state
+    return xkb_keysym(keycode, (state >> 13) & 0x3, state);
+}
+
+int keymap_handle_event(xcb_generic_event_t *event)
+{
+    uint8_t type = event->response_type & ~0x80;
+    if (type == XCB_MAPPING_NOTIFY)
+    {
+        // with xkb, its map notify follows
+        xcb_mapping_notify_event_t *mn = (xcb_mapping_notify_event_t *) event;
+        if (mn->request != XCB_MAPPING_KEYBOARD || xkb_available)
+        {
+            return 0;
+        }
+
+        LOG("mapping notify (first: %i, count: %i)\n", mn->first_keycode, mn->count);
+        return load_keyboard_mapping(mn->first_keycode, mn->count) == 0;
+    }
+
+    if (!xkb_available || type != xkb_event_base)
+    {
+        return 0;
+    }
+
+    // all xkb events share the same type, the actual event is in the second byte
+    switch (event->pad0)
+    {
+    case XCB_XKB_NEW_KEYBOARD_NOTIFY:
+    case XCB_XKB_MAP_NOTIFY:
+        LOG("xkb map changed\n");
+        return reload_xkb_map() == 0;
+    case XCB_XKB_STATE_NOTIFY:
+    {
+        xcb_xkb_state_notify_event_t *sn = (xcb_xkb_state_notify_event_t *) event;
+        if (sn->group == active_group)
+        {
+            return 0;
+        }
+
+        LOG("active group changed (group: %i)\n", sn->group);
+        active_group = sn->group;
+        return 1;
+    }
+    }
+
+    return 0;
+}
+
+int keymap_verify()
+{
+    if (!mapping_pending)
+    {
+        return 0;
+    }
+
+    mapping_pending = 0;
+    xcb_get_keyboard_mapping_reply_t *reply = xcb_get_keyboard_mapping_reply(connection, pending_cookie, NULL);
+    trace_x_round_trip();
+    if (reply == NULL)
+    {
+        LOG("cannot verify cached keyboard mapping\n");
+        return 0;
+    }
+
+    size_t count = (size_t) (max_keycode - min_keycode + 1) * reply->keysyms_per_keycode;
+    int same = (reply->keysyms_per_keycode == keysyms_per_keycode &&
+                memcmp(table, xcb_get_keyboard_mapping_keysyms(reply), count * sizeof(xcb_keysym_t)) == 0);
+    if (same)
+    {
+        free(reply);
+        return 0;
+    }
+
+    xcb_keysym_t *resized = realloc(table, count * sizeof(xcb_keysym_t));
+    if (resized == NULL)
+    {
+        LOG("cannot allocate keysym table\n");
+        free(reply);
+        return 0;
+    }
+
+    LOG("cached keyboard mapping is outdated\n");
+    table = resized;
+    keysyms_per_keycode = reply->keysyms_per_keycode;
+    memcpy(table, xcb_get_keyboard_mapping_keysyms(reply), count * sizeof(xcb_keysym_t));
+    free(reply);
+
+    return 1;
+}
+
+void keymap_export(Cache *cache)
+{
+    if (xkb_available)
+    {
+        // the xkb map isn't cached, see the top of this file
+        cache->min_keycode = 1;
+        cache->max_keycode = 0;
+        cache->keysyms_per_keycode = 0;
+        cache->keysyms = NULL;
+        return;
+    }
+
+    cache->min_keycode = min_keycode;
+    cache->max_keycode = max_keycode;
+    cache->keysyms_per_keycode = keysyms_per_keycode;
+    cache->keysyms = table;
+}
+
+void keymap_free()
+{
+    discard_pending_mapping();
+    free(table);
+    table = NULL;
+    keysyms_per_keycode = 0;
+    free_xkb_map();
+    xkb_available = 0;
+    active_group = 0;
+    connection = NULL;
+}
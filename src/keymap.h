@@ -0,0 +1,15 @@
+#ifndef I3_EASYFOCUS_KEYMAP
+#define I3_EASYFOCUS_KEYMAP
+
+#include <xcb/xcb.h>
+#include "cache.h"
+
+int keymap_init(xcb_connection_t *conn, const Cache *cache);
+int keymap_verify();
+void keymap_export(Cache *cache);
+int keymap_keycodes(xcb_keysym_t keysym, xcb_keycode_t *keycodes, int max_keycodes);
+xcb_keysym_t keymap_lookup(xcb_keycode_t keycode, uint16_t state);
+int keymap_handle_event(xcb_generic_event_t *event);
+void keymap_free();
+
+#endif
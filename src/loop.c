@@ -0,0 +1,211 @@
+#include "loop.h"
+#include "util.h"
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <glib.h>
+
+/*
+ * Waits on the X connection and on the sockets of glib's default main
+ * context at once, which is where i3ipc-glib reads i3's events. glib is
+ * driven by hand (prepare, query, check, dispatch), so that its sockets can
+ * be watched by the same epoll instance as the X connection.
+ */
+
+#define LOOP_MAX_GLIB_FDS 16
+
+static int epoll_fd = -1;
+static int watched_fd = -1;
+static GPollFD registered[LOOP_MAX_GLIB_FDS];
+static int num_registered = 0;
+
+static uint32_t to_epoll_events(gushort events)
+{
+    uint32_t mask = 0;
+    if (events & G_IO_IN)
+        mask |= EPOLLIN;
+    if (events & G_IO_OUT)
+        mask |= EPOLLOUT;
+    if (events & G_IO_PRI)
+        mask |= EPOLLPRI;
+    return mask;
+}
+
+static gushort to_glib_events(uint32_t events)
+{
+    gushort mask = 0;
+    if (events & EPOLLIN)
+        mask |= G_IO_IN;
+    if (events & EPOLLOUT)
+        mask |= G_IO_OUT;
+    if (events & EPOLLPRI)
+        mask |= G_IO_PRI;
+    if (events & EPOLLERR)
+        mask |= G_IO_ERR;
+    if (events & EPOLLHUP)
+        mask |= G_IO_HUP;
+    return mask;
+}
+
+static int find_fd(const GPollFD *fds, int count, int fd)
+{
+    int i;
+    for (i = 0; i < count; i++)
+    {
+        if (fds[i].fd == fd)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// glib's sockets rarely change, so only the differences are passed to epoll
+static void sync_glib_fds(GPollFD *fds, int count)
+{
+    int i;
+    for (i = 0; i < num_registered; i++)
+    {
+        if (find_fd(fds, count, registered[i].fd) == -1)
+        {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, registered[i].fd, NULL);
+        }
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        struct epoll_event event = {to_epoll_events(fds[i].events), {.fd = fds[i].fd}};
+        int old = find_fd(registered, num_registered, fds[i].fd);
+        if (old == -1)
+        {
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fds[i].fd, &event);
+        }
+        else if (registered[old].events != fds[i].events)
+        {
+            epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fds[i].fd, &event);
+        }
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        registered[i] = fds[i];
+    }
+    num_registered = count;
+}
+
+int loop_init(int fd)
+{
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1)
+    {
+        LOG("cannot create epoll instance\n");
+        return 1;
+    }
+
+    struct epoll_event event = {EPOLLIN, {.fd = fd}};
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1)
+    {
+        LOG("cannot watch fd %i\n", fd);
+        close(epoll_fd);
+        epoll_fd = -1;
+        return 1;
+    }
+
+    watched_fd = fd;
+    num_registered = 0;
+    return 0;
+}
+
+/*
+ * Blocks until the watched fd is readable, glib dispatched events or the
+ * timeout expires (-1 waits forever). Returns a mask of LOOP_FD_READY and
+ * LOOP_IPC_DISPATCHED.
+ */
+int loop_wait(int timeout_ms)
+{
+    GMainContext *context = g_main_context_default();
+    int owns_context = g_main_context_acquire(context);
+
+    GPollFD fds[LOOP_MAX_GLIB_FDS];
+    gint max_priority = 0;
+    int count = 0;
+    if (owns_context)
+    {
+        gint glib_timeout = -1;
+        if (g_main_context_prepare(context, &max_priority))
+        {
+            // a source is ready without waiting
+            timeout_ms = 0;
+        }
+
+        count = g_main_context_query(context, max_priority, &glib_timeout, fds, LOOP_MAX_GLIB_FDS);
+        if (count > LOOP_MAX_GLIB_FDS)
+        {
+            LOG("glib watches %i fds, only %i are polled\n", count, LOOP_MAX_GLIB_FDS);
+            count = LOOP_MAX_GLIB_FDS;
+        }
+
+        int i;
+        for (i = 0; i < count; i++)
+        {
+            fds[i].revents = 0;
+        }
+
+        if (glib_timeout >= 0 && (timeout_ms < 0 || glib_timeout < timeout_ms))
+        {
+            timeout_ms = glib_timeout;
+        }
+
+        sync_glib_fds(fds, count);
+    }
+
+    struct epoll_event events[LOOP_MAX_GLIB_FDS + 1];
+    int ready = epoll_wait(epoll_fd, events, LOOP_MAX_GLIB_FDS + 1, timeout_ms);
+    if (ready == -1 && errno != EINTR)
+    {
+        LOG("epoll_wait failed (errno: %i)\n", errno);
+    }
+
+    int result = 0;
+    int i;
+    for (i = 0; i < ready; i++)
+    {
+        if (events[i].data.fd == watched_fd)
+        {
+            result |= LOOP_FD_READY;
+            continue;
+        }
+
+        int index = find_fd(fds, count, events[i].data.fd);
+        if (index != -1)
+        {
+            fds[index].revents = to_glib_events(events[i].events);
+        }
+    }
+
+    if (owns_context)
+    {
+        if (g_main_context_check(context, max_priority, fds, count))
+        {
+            g_main_context_dispatch(context);
+            result |= LOOP_IPC_DISPATCHED;
+        }
+        g_main_context_release(context);
+    }
+
+    return result;
+}
+
+void loop_finish()
+{
+    if (epoll_fd != -1)
+    {
+        close(epoll_fd);
+    }
+
+    epoll_fd = -1;
+    watched_fd = -1;
+    num_registered = 0;
+}
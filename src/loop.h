@@ -0,0 +1,11 @@
+#ifndef I3_EASYFOCUS_LOOP
+#define I3_EASYFOCUS_LOOP
+
+#define LOOP_FD_READY 1
+#define LOOP_IPC_DISPATCHED 2
+
+int loop_init(int fd);
+int loop_wait(int timeout_ms);
+void loop_finish();
+
+#endif
@@ -5,26 +5,64 @@
 #include <X11/keysym.h>
 #include <X11/keysymdef.h>
 #include <stdlib.h>
+#include <string.h>
+
+#define LABEL_KEYSYM(name) XK_##name,
 
 #define LENGTH_AVY (sizeof(label_avy_keysyms) / sizeof(label_avy_keysyms[0]))
-static xcb_keysym_t label_avy_keysyms[] = LABEL_KEYSYMS_AVY;
+static xcb_keysym_t label_avy_keysyms[] = {LABEL_KEYS_AVY(LABEL_KEYSYM)};
 
 #define LENGTH_COLEMAK (sizeof(label_colemak_keysyms) / sizeof(label_colemak_keysyms[0]))
-static xcb_keysym_t label_colemak_keysyms[] = LABEL_KEYSYMS_COLEMAK;
+static xcb_keysym_t label_colemak_keysyms[] = {LABEL_KEYS_COLEMAK(LABEL_KEYSYM)};
 
 #define LENGTH_ALPHA (sizeof(label_alpha_keysyms) / sizeof(label_alpha_keysyms[0]))
-static xcb_keysym_t label_alpha_keysyms[] = LABEL_KEYSYMS_ALPHA;
+static xcb_keysym_t label_alpha_keysyms[] = {LABEL_KEYS_ALPHA(LABEL_KEYSYM)};
+
+/*
+ * The names of the keysyms of all LABEL_KEYS_* sets, as XKeysymToString
+ * would return them. They come from the same lists as the sets, so a key
+ * added to a set has its name. Keys in several sets are listed once per set.
+ */
+#define KEYSYM_NAME(name) {XK_##name, #name},
+
+typedef struct keysym_name
+{
+    xcb_keysym_t keysym;
+    const char *name;
+} KeysymName;
+
+static const KeysymName keysym_names[] = {
+    LABEL_KEYS_AVY(KEYSYM_NAME)
+    LABEL_KEYS_COLEMAK(KEYSYM_NAME)
+    LABEL_KEYS_ALPHA(KEYSYM_NAME)};
+
+typedef struct map_entry
+{
+    Window *win;
+    xcb_window_t label;
+} MapEntry;
 
 static xcb_keysym_t *label_keysyms = NULL;
 
-static Window **win_map = NULL;
+static MapEntry *win_map = NULL;
 static size_t map_length = 0;
-static size_t current = 0;
 
-void map_init(label_key_mode_e mode)
+static MapEntry *entry_by_keysym(xcb_keysym_t keysym)
 {
-    current = 0;
+    size_t i;
+    for (i = 0; i < map_length; i++)
+    {
+        if (label_keysyms[i] == keysym)
+        {
+            return &win_map[i];
+        }
+    }
+
+    return NULL;
+}
 
+void map_init(label_key_mode_e mode)
+{
     switch(mode)
     {
     case LABEL_KEY_MODE_AVY:
@@ -40,36 +78,107 @@ void map_init(label_key_mode_e mode)
         map_length = LENGTH_COLEMAK;
         break;
     }
-    win_map = calloc(map_length, sizeof(Window*));
+    win_map = calloc(map_length, sizeof(MapEntry));
+}
+
+xcb_keysym_t map_add_key(Window *win, xcb_keysym_t keysym)
+{
+    size_t i;
+    for (i = 0; i < map_length; i++)
+    {
+        if (label_keysyms[i] == keysym)
+        {
+            if (win_map[i].win != NULL)
+            {
+                return XCB_NO_SYMBOL;
+            }
+
+            win_map[i].win = win;
+            win_map[i].label = XCB_WINDOW_NONE;
+            return keysym;
+        }
+    }
+
+    // not in the active set of keys
+    return XCB_NO_SYMBOL;
 }
 
 xcb_keysym_t map_add(Window *win)
 {
-    if (current >= map_length)
+    size_t i;
+    for (i = 0; i < map_length; i++)
+    {
+        if (win_map[i].win == NULL)
+        {
+            win_map[i].win = win;
+            win_map[i].label = XCB_WINDOW_NONE;
+            return label_keysyms[i];
+        }
+    }
+
+    LOG("too many windows, only configured %lu keysyms\n", map_length);
+    return XCB_NO_SYMBOL;
+}
+
+void map_replace(xcb_keysym_t keysym, Window *win)
+{
+    MapEntry *entry = entry_by_keysym(keysym);
+    if (entry != NULL)
     {
-        LOG("too many windows, only configured %lu keysyms\n", map_length);
-        return XCB_NO_SYMBOL;
+        entry->win = win;
     }
+}
 
-    size_t key = current;
-    current++;
-    win_map[key] = win;
-    return label_keysyms[key];
+void map_remove(xcb_keysym_t keysym)
+{
+    MapEntry *entry = entry_by_keysym(keysym);
+    if (entry != NULL)
+    {
+        entry->win = NULL;
+        entry->label = XCB_WINDOW_NONE;
+    }
 }
 
 Window *map_get(xcb_keysym_t keysym)
+{
+    MapEntry *entry = entry_by_keysym(keysym);
+    if (entry == NULL || entry->win == NULL)
+    {
+        LOG("selection not in range\n");
+        return NULL;
+    }
+
+    return entry->win;
+}
+
+xcb_keysym_t map_get_keysym(Window *win)
 {
     size_t i;
-    for (i = 0; i < map_length && i < current; i++)
+    for (i = 0; i < map_length; i++)
     {
-        if (label_keysyms[i] == keysym)
+        if (win_map[i].win == win)
         {
-            return win_map[i];
+            return label_keysyms[i];
         }
     }
 
-    LOG("selection not in range\n");
-    return NULL;
+    LOG("window not in map\n");
+    return XCB_NO_SYMBOL;
+}
+
+void map_set_label(xcb_keysym_t keysym, xcb_window_t label)
+{
+    MapEntry *entry = entry_by_keysym(keysym);
+    if (entry != NULL)
+    {
+        entry->label = label;
+    }
+}
+
+xcb_window_t map_get_label(xcb_keysym_t keysym)
+{
+    MapEntry *entry = entry_by_keysym(keysym);
+    return entry == NULL ? XCB_WINDOW_NONE : entry->label;
 }
 
 void map_free()
@@ -77,5 +186,33 @@ void map_free()
     free(win_map);
     win_map = NULL;
     map_length = 0;
-    current = 0;
+}
+
+xcb_keysym_t map_keysym_from_name(const char *name)
+{
+    size_t i;
+    for (i = 0; i < sizeof(keysym_names) / sizeof(keysym_names[0]); i++)
+    {
+        if (strcmp(keysym_names[i].name, name) == 0)
+        {
+            return keysym_names[i].keysym;
+        }
+    }
+
+    return XCB_NO_SYMBOL;
+}
+
+const char *map_keysym_name(xcb_keysym_t keysym)
+{
+    size_t i;
+    for (i = 0; i < sizeof(keysym_names) / sizeof(keysym_names[0]); i++)
+    {
+        if (keysym_names[i].keysym == keysym)
+        {
+            return keysym_names[i].name;
+        }
+    }
+
+    LOG("no name for keysym %u\n", keysym);
+    return NULL;
 }
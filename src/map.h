@@ -15,7 +15,15 @@ typedef enum
 
 void map_init(label_key_mode_e mode);
 xcb_keysym_t map_add(Window *win);
+xcb_keysym_t map_add_key(Window *win, xcb_keysym_t keysym);
+void map_replace(xcb_keysym_t keysym, Window *win);
+void map_remove(xcb_keysym_t keysym);
 Window *map_get(xcb_keysym_t keysym);
+xcb_keysym_t map_get_keysym(Window *win);
+void map_set_label(xcb_keysym_t keysym, xcb_window_t label);
+xcb_window_t map_get_label(xcb_keysym_t keysym);
 void map_free();
+const char *map_keysym_name(xcb_keysym_t keysym);
+xcb_keysym_t map_keysym_from_name(const char *name);
 
 #endif
@@ -0,0 +1,820 @@
+#include "place.h"
+#include "util.h"
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Runs between the visibility walk and the creation of the labels: floating
+ * windows that are completely hidden behind floating windows above them are
+ * dropped, and labels that would be drawn on top of each other are moved
+ * apart. Only the latter needs the size of the labels.
+ *
+ * Overlapping floating windows are found with a sweep line over their left
+ * and right edges, keeping the windows the line crosses in an array sorted by
+ * their top edge. A window entering the set is compared with the ones that
+ * start between its top edge minus the tallest window's height and its
+ * bottom edge, which on a desktop are close to the windows it overlaps. Each
+ * window is then checked against the k_i windows above it that overlap it in
+ * O(k_i log k_i). With n windows, k overlapping pairs and at most m windows
+ * crossed by the sweep line at once this takes O(n log n + n m + k log k),
+ * where the n m part, comparisons and moves within the array, stays small as
+ * long as a window only meets a few others at its left edge. It is not
+ * O(n log n) in general: when all windows overlap, or all of them span the
+ * same columns, k or m grow with n and this is O(n^2) or worse.
+ * bench/bench-place measures both cases.
+ *
+ * Labels are looked up in a hash grid with cells of the size of a label, so
+ * that placed labels, which do not overlap each other, are found in constant
+ * time. A label moves past one placed label at a time, so n labels placed on
+ * the same spot take O(n^2) moves.
+ */
+
+typedef struct box
+{
+    int x0;
+    int y0;
+    int x1; // exclusive
+    int y1; // exclusive
+} Box;
+
+typedef struct grid_entry
+{
+    size_t item;
+    int next;
+} GridEntry;
+
+typedef struct grid_cell
+{
+    int col;
+    int row;
+    int first; // index of the cell's first entry, -1 if the slot is free
+} GridCell;
+
+typedef struct grid
+{
+    int cell_width;
+    int cell_height;
+    GridCell *cells; // open addressing, the capacity is a power of two
+    size_t capacity;
+    GridEntry *entries;
+    size_t entries_length;
+    size_t entries_capacity;
+    unsigned *stamps; // last query that returned an item, to report it once
+    unsigned query;
+} Grid;
+
+typedef struct label
+{
+    Window *win;
+    size_t order;
+    Box box;
+} Label;
+
+static int boxes_overlap(const Box *a, const Box *b)
+{
+    return a->x0 < b->x1 && b->x0 < a->x1 && a->y0 < b->y1 && b->y0 < a->y1;
+}
+
+static int clamp(int value, int min, int max)
+{
+    return value < min ? min : (value > max ? max : value);
+}
+
+// every box is as large as a cell, so it is in at most four of them
+static int grid_init(Grid *grid, int cell_width, int cell_height, size_t items)
+{
+    size_t capacity = 16;
+    while (capacity < 8 * items)
+    {
+        capacity *= 2;
+    }
+
+    grid->cell_width = cell_width > 0 ? cell_width : 1;
+    grid->cell_height = cell_height > 0 ? cell_height : 1;
+    grid->cells = malloc(sizeof(GridCell) * capacity);
+    grid->capacity = capacity;
+    grid->entries = malloc(sizeof(GridEntry) * 4 * items);
+    grid->entries_length = 0;
+    grid->entries_capacity = 4 * items;
+    grid->stamps = calloc(items, sizeof(unsigned));
+    grid->query = 0;
+    if (grid->cells == NULL || grid->entries == NULL || grid->stamps == NULL)
+    {
+        free(grid->cells);
+        free(grid->entries);
+        free(grid->stamps);
+        grid->cells = NULL;
+        grid->entries = NULL;
+        grid->stamps = NULL;
+        return 1;
+    }
+
+    size_t i;
+    for (i = 0; i < capacity; i++)
+    {
+        grid->cells[i].first = -1;
+    }
+
+    return 0;
+}
+
+static void grid_free(Grid *grid)
+{
+    free(grid->cells);
+    free(grid->entries);
+    free(grid->stamps);
+}
+
+// rounds towards negative infinity, labels may start left of the screen
+static int grid_coordinate(int value, int size)
+{
+    return value >= 0 ? value / size : -((-value + size - 1) / size);
+}
+
+static GridCell *grid_cell(Grid *grid, int col, int row, int create)
+{
+    size_t hash = ((unsigned) col * 73856093u) ^ ((unsigned) row * 19349663u);
+    size_t i;
+    for (i = hash & (grid->capacity - 1); grid->cells[i].first != -1; i = (i + 1) & (grid->capacity - 1))
+    {
+        if (grid->cells[i].col == col && grid->cells[i].row == row)
+        {
+            return &grid->cells[i];
+        }
+    }
+
+    if (!create)
+    {
+        return NULL;
+    }
+
+    grid->cells[i].col = col;
+    grid->cells[i].row = row;
+    return &grid->cells[i];
+}
+
+static int grid_insert(Grid *grid, const Box *box, size_t item)
+{
+    int col0 = grid_coordinate(box->x0, grid->cell_width);
+    int col1 = grid_coordinate(box->x1 - 1, grid->cell_width);
+    int row0 = grid_coordinate(box->y0, grid->cell_height);
+    int row1 = grid_coordinate(box->y1 - 1, grid->cell_height);
+
+    int col, row;
+    for (row = row0; row <= row1; row++)
+    {
+        for (col = col0; col <= col1; col++)
+        {
+            if (grid->entries_length == grid->entries_capacity)
+            {
+                return 1;
+            }
+
+            GridCell *cell = grid_cell(grid, col, row, 1);
+            GridEntry *entry = &grid->entries[grid->entries_length];
+            entry->item = item;
+            entry->next = cell->first;
+            cell->first = (int) grid->entries_length++;
+        }
+    }
+
+    return 0;
+}
+
+// collects the items in the cells touched by the box, each one only once
+static size_t grid_query(Grid *grid, const Box *box, size_t *items)
+{
+    int col0 = grid_coordinate(box->x0, grid->cell_width);
+    int col1 = grid_coordinate(box->x1 - 1, grid->cell_width);
+    int row0 = grid_coordinate(box->y0, grid->cell_height);
+    int row1 = grid_coordinate(box->y1 - 1, grid->cell_height);
+    grid->query++;
+
+    size_t count = 0;
+    int col, row;
+    for (row = row0; row <= row1; row++)
+    {
+        for (col = col0; col <= col1; col++)
+        {
+            GridCell *cell = grid_cell(grid, col, row, 0);
+            int e;
+            for (e = cell != NULL ? cell->first : -1; e != -1; e = grid->entries[e].next)
+            {
+                size_t item = grid->entries[e].item;
+                if (grid->stamps[item] != grid->query)
+                {
+                    grid->stamps[item] = grid->query;
+                    items[count++] = item;
+                }
+            }
+        }
+    }
+
+    return count;
+}
+
+static Box window_box(const Window *win)
+{
+    Box box = {win->rect.x, win->rect.y, win->rect.x + win->rect.width, win->rect.y + win->rect.height};
+    return box;
+}
+
+static int compare_ints(const void *a, const void *b)
+{
+    int ia = *(const int *) a;
+    int ib = *(const int *) b;
+    return (ia > ib) - (ia < ib);
+}
+
+typedef struct edge
+{
+    int x;
+    int delta; // +1 where a covering box starts, -1 where it ends
+    int y0;
+    int y1;
+} Edge;
+
+// scratch space of box_covered, sized for all floating windows once
+typedef struct sweep
+{
+    Edge *edges;
+    int *ys;
+    int *cover; // per segment tree node, boxes spanning all of it
+    long *length; // per segment tree node, covered part of it
+} Sweep;
+
+static int compare_edges(const void *a, const void *b)
+{
+    return compare_ints(&((const Edge *) a)->x, &((const Edge *) b)->x);
+}
+
+static size_t y_index(const Sweep *sweep, size_t num_ys, int y)
+{
+    const int *found = bsearch(&y, sweep->ys, num_ys, sizeof(int), compare_ints);
+    return (size_t) (found - sweep->ys);
+}
+
+// node covers ys[lo] to ys[hi], a and b are the edge's range in ys
+static void sweep_update(Sweep *sweep, size_t node, size_t lo, size_t hi, size_t a, size_t b, int delta)
+{
+    if (b <= lo || hi <= a)
+    {
+        return;
+    }
+
+    if (a <= lo && hi <= b)
+    {
+        sweep->cover[node] += delta;
+    }
+    else
+    {
+        size_t mid = (lo + hi) / 2;
+        sweep_update(sweep, 2 * node, lo, mid, a, b, delta);
+        sweep_update(sweep, 2 * node + 1, mid, hi, a, b, delta);
+    }
+
+    if (sweep->cover[node] > 0)
+    {
+        sweep->length[node] = (long) sweep->ys[hi] - sweep->ys[lo];
+    }
+    else if (hi - lo == 1)
+    {
+        sweep->length[node] = 0;
+    }
+    else
+    {
+        sweep->length[node] = sweep->length[2 * node] + sweep->length[2 * node + 1];
+    }
+}
+
+/*
+ * Sweeps a vertical line over the box, keeping the covered part of the line
+ * in a segment tree over the covering boxes' top and bottom edges. The box is
+ * covered if no position of the line leaves a gap. For count covering boxes
+ * this takes O(count log count).
+ */
+static int box_covered(const Box *box, const Box *above, size_t count, Sweep *sweep)
+{
+    size_t num_edges = 0;
+    size_t num_ys = 0;
+    sweep->ys[num_ys++] = box->y0;
+    sweep->ys[num_ys++] = box->y1;
+
+    size_t i;
+    for (i = 0; i < count; i++)
+    {
+        Box clipped = {clamp(above[i].x0, box->x0, box->x1), clamp(above[i].y0, box->y0, box->y1),
+                       clamp(above[i].x1, box->x0, box->x1), clamp(above[i].y1, box->y0, box->y1)};
+        if (clipped.x0 < clipped.x1 && clipped.y0 < clipped.y1)
+        {
+            Edge start = {clipped.x0, 1, clipped.y0, clipped.y1};
+            Edge end = {clipped.x1, -1, clipped.y0, clipped.y1};
+            sweep->edges[num_edges++] = start;
+            sweep->edges[num_edges++] = end;
+            sweep->ys[num_ys++] = clipped.y0;
+            sweep->ys[num_ys++] = clipped.y1;
+        }
+    }
+    qsort(sweep->edges, num_edges, sizeof(Edge), compare_edges);
+    qsort(sweep->ys, num_ys, sizeof(int), compare_ints);
+
+    size_t unique = 1;
+    for (i = 1; i < num_ys; i++)
+    {
+        if (sweep->ys[i] != sweep->ys[unique - 1])
+        {
+            sweep->ys[unique++] = sweep->ys[i];
+        }
+    }
+    num_ys = unique;
+    memset(sweep->cover, 0, sizeof(int) * 4 * num_ys);
+    memset(sweep->length, 0, sizeof(long) * 4 * num_ys);
+
+    long height = (long) box->y1 - box->y0;
+    int x = box->x0;
+    for (i = 0; i < num_edges; i++)
+    {
+        Edge *edge = &sweep->edges[i];
+        if (edge->x > x && sweep->length[1] < height)
+        {
+            return 0;
+        }
+
+        x = edge->x;
+        sweep_update(sweep, 1, 0, num_ys - 1, y_index(sweep, num_ys, edge->y0), y_index(sweep, num_ys, edge->y1), edge->delta);
+    }
+
+    return x >= box->x1;
+}
+
+static int compare_stacking(const void *a, const void *b)
+{
+    const Window *wa = *(Window *const *) a;
+    const Window *wb = *(Window *const *) b;
+    return (wa->stacking > wb->stacking) - (wa->stacking < wb->stacking);
+}
+
+static int compare_sizes(const void *a, const void *b)
+{
+    size_t sa = *(const size_t *) a;
+    size_t sb = *(const size_t *) b;
+    return (sa > sb) - (sa < sb);
+}
+
+typedef struct window_edge
+{
+    int x;
+    int starts; // 1 at the window's left edge, 0 at its right one
+    size_t item;
+} WindowEdge;
+
+typedef struct pair
+{
+    size_t lower;
+    size_t upper;
+} Pair;
+
+// per window, the overlapping windows higher in the stack
+typedef struct overlaps
+{
+    size_t *first; // where each window's ones start in above, count + 1 of them
+    size_t *above;
+} Overlaps;
+
+static int compare_window_edges(const void *a, const void *b)
+{
+    const WindowEdge *ea = a;
+    const WindowEdge *eb = b;
+    if (ea->x != eb->x)
+        return compare_ints(&ea->x, &eb->x);
+    // windows that only touch do not overlap
+    return ea->starts - eb->starts;
+}
+
+// where the item is or belongs in the active windows, sorted by top edge
+static size_t active_position(const Box *boxes, const size_t *active, size_t num_active, int y0, size_t item)
+{
+    size_t lo = 0;
+    size_t hi = num_active;
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        size_t other = active[mid];
+        if (boxes[other].y0 < y0 || (boxes[other].y0 == y0 && other < item))
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+static int add_pair(Pair **pairs, size_t *length, size_t *capacity, size_t a, size_t b)
+{
+    if (*length == *capacity)
+    {
+        size_t grown = *capacity == 0 ? 32 : *capacity * 2;
+        Pair *resized = realloc(*pairs, sizeof(Pair) * grown);
+        if (resized == NULL)
+        {
+            return 1;
+        }
+
+        *pairs = resized;
+        *capacity = grown;
+    }
+
+    (*pairs)[*length].lower = a < b ? a : b;
+    (*pairs)[*length].upper = a < b ? b : a;
+    (*length)++;
+    return 0;
+}
+
+// boxes are in stacking order, so the higher index of a pair is above
+static int find_overlaps(const Box *boxes, size_t count, Overlaps *overlaps)
+{
+    WindowEdge *edges = malloc(sizeof(WindowEdge) * 2 * count);
+    size_t *active = malloc(sizeof(size_t) * count);
+    Pair *pairs = NULL;
+    size_t num_pairs = 0;
+    size_t pairs_capacity = 0;
+    overlaps->first = calloc(count + 1, sizeof(size_t));
+    overlaps->above = NULL;
+    int failed = (edges == NULL || active == NULL || overlaps->first == NULL);
+
+    size_t num_edges = 0;
+    int max_height = 0;
+    size_t i;
+    for (i = 0; !failed && i < count; i++)
+    {
+        if (boxes[i].x0 < boxes[i].x1 && boxes[i].y0 < boxes[i].y1)
+        {
+            max_height = boxes[i].y1 - boxes[i].y0 > max_height ? boxes[i].y1 - boxes[i].y0 : max_height;
+            WindowEdge left = {boxes[i].x0, 1, i};
+            WindowEdge right = {boxes[i].x1, 0, i};
+            edges[num_edges++] = left;
+            edges[num_edges++] = right;
+        }
+    }
+
+    if (!failed)
+    {
+        qsort(edges, num_edges, sizeof(WindowEdge), compare_window_edges);
+    }
+
+    size_t num_active = 0;
+    for (i = 0; !failed && i < num_edges; i++)
+    {
+        size_t item = edges[i].item;
+        size_t position = active_position(boxes, active, num_active, boxes[item].y0, item);
+        if (!edges[i].starts)
+        {
+            memmove(&active[position], &active[position + 1], sizeof(size_t) * (num_active - position - 1));
+            num_active--;
+            continue;
+        }
+
+        // windows starting further up than the tallest one end above this one
+        size_t a;
+        for (a = active_position(boxes, active, num_active, boxes[item].y0 - max_height, 0); !failed && a < num_active && boxes[active[a]].y0 < boxes[item].y1; a++)
+        {
+            if (boxes[active[a]].y1 > boxes[item].y0)
+            {
+                failed = add_pair(&pairs, &num_pairs, &pairs_capacity, active[a], item);
+            }
+        }
+
+        memmove(&active[position + 1], &active[position], sizeof(size_t) * (num_active - position));
+        active[position] = item;
+        num_active++;
+    }
+
+    if (!failed)
+    {
+        overlaps->above = malloc(sizeof(size_t) * (num_pairs + 1));
+        failed = (overlaps->above == NULL);
+    }
+
+    if (!failed)
+    {
+        for (i = 0; i < num_pairs; i++)
+        {
+            overlaps->first[pairs[i].lower + 1]++;
+        }
+        for (i = 0; i < count; i++)
+        {
+            overlaps->first[i + 1] += overlaps->first[i];
+        }
+
+        // active is free again and counts the ones filled in per window
+        memset(active, 0, sizeof(size_t) * count);
+        for (i = 0; i < num_pairs; i++)
+        {
+            size_t lower = pairs[i].lower;
+            overlaps->above[overlaps->first[lower] + active[lower]++] = pairs[i].upper;
+        }
+    }
+
+    if (failed)
+    {
+        free(overlaps->first);
+        free(overlaps->above);
+        overlaps->first = NULL;
+        overlaps->above = NULL;
+    }
+
+    free(edges);
+    free(active);
+    free(pairs);
+    return failed;
+}
+
+/*
+ * Needs only the windows' geometry, so it runs before the keys are assigned
+ * both when labels are shown and with --dump.
+ */
+Window *drop_occluded_windows(Window *windows)
+{
+    size_t count = 0;
+    Window *win;
+    for (win = windows; win != NULL; win = win->next)
+    {
+        count += (win->floating && !win->hidden);
+    }
+
+    if (count < 2)
+    {
+        return windows;
+    }
+
+    // floating windows are checked from the bottom to the top of the stack,
+    // the list itself may be in the order of the labels' keys
+    Window **floating = malloc(sizeof(Window *) * count);
+    Box *boxes = malloc(sizeof(Box) * count);
+    Box *above = malloc(sizeof(Box) * count);
+    size_t *items = malloc(sizeof(size_t) * count);
+    char *occluded = calloc(count, sizeof(char));
+    Sweep sweep;
+    sweep.edges = malloc(sizeof(Edge) * 2 * count);
+    sweep.ys = malloc(sizeof(int) * (2 * count + 2));
+    sweep.cover = malloc(sizeof(int) * 4 * (2 * count + 2));
+    sweep.length = malloc(sizeof(long) * 4 * (2 * count + 2));
+    Overlaps overlaps;
+    int failed = (floating == NULL || boxes == NULL || above == NULL || items == NULL || occluded == NULL ||
+                  sweep.edges == NULL || sweep.ys == NULL || sweep.cover == NULL || sweep.length == NULL);
+
+    if (!failed)
+    {
+        size_t i = 0;
+        for (win = windows; win != NULL; win = win->next)
+        {
+            if (win->floating && !win->hidden)
+            {
+                floating[i++] = win;
+            }
+        }
+
+        qsort(floating, count, sizeof(Window *), compare_stacking);
+        for (i = 0; i < count; i++)
+        {
+            boxes[i] = window_box(floating[i]);
+        }
+
+        failed = find_overlaps(boxes, count, &overlaps);
+        for (i = 0; !failed && i < count; i++)
+        {
+            size_t num_above = 0;
+            size_t n;
+            for (n = overlaps.first[i]; n < overlaps.first[i + 1]; n++)
+            {
+                above[num_above++] = boxes[overlaps.above[n]];
+            }
+
+            occluded[i] = num_above > 0 && box_covered(&boxes[i], above, num_above, &sweep);
+        }
+
+        if (!failed)
+        {
+            free(overlaps.first);
+            free(overlaps.above);
+        }
+    }
+
+    if (failed)
+    {
+        LOG("cannot check windows for occlusion\n");
+    }
+    else
+    {
+        // dropped windows are freed, so they are found by their stacking
+        size_t i;
+        for (i = 0; i < count; i++)
+        {
+            items[i] = floating[i]->stacking;
+        }
+
+        Window **link = &windows;
+        while (*link != NULL)
+        {
+            win = *link;
+            size_t *found = (win->floating && !win->hidden) ? bsearch(&win->stacking, items, count, sizeof(size_t), compare_sizes) : NULL;
+            if (found != NULL && occluded[found - items])
+            {
+                LOG("dropping occluded window (id: %lu)\n", win->id);
+                *link = win->next;
+                win->next = NULL;
+                window_free(win);
+            }
+            else
+            {
+                link = &win->next;
+            }
+        }
+    }
+
+    free(floating);
+    free(boxes);
+    free(above);
+    free(items);
+    free(occluded);
+    free(sweep.edges);
+    free(sweep.ys);
+    free(sweep.cover);
+    free(sweep.length);
+
+    return windows;
+}
+
+static int compare_labels(const void *a, const void *b)
+{
+    const Label *la = a;
+    const Label *lb = b;
+    if (la->box.y0 != lb->box.y0)
+        return compare_ints(&la->box.y0, &lb->box.y0);
+    if (la->box.x0 != lb->box.x0)
+        return compare_ints(&la->box.x0, &lb->box.x0);
+    return (la->order > lb->order) - (la->order < lb->order);
+}
+
+/*
+ * Labels are placed from the top left to the bottom right. A label that hits
+ * an already placed one moves to the right of it, or below it once it would
+ * leave its window.
+ */
+static void separate_labels(Window *windows, int label_width, int label_height)
+{
+    size_t count = 0;
+    Window *win;
+    for (win = windows; win != NULL; win = win->next)
+    {
+        count += !win->hidden;
+    }
+
+    if (count < 2)
+    {
+        return;
+    }
+
+    Label *labels = malloc(sizeof(Label) * count);
+    size_t *items = malloc(sizeof(size_t) * count);
+    if (labels == NULL || items == NULL)
+    {
+        LOG("cannot separate labels\n");
+        free(labels);
+        free(items);
+        return;
+    }
+
+    size_t i = 0;
+    for (win = windows; win != NULL; win = win->next)
+    {
+        if (win->hidden)
+        {
+            continue;
+        }
+
+        labels[i].win = win;
+        labels[i].order = win->stacking;
+        labels[i].box.x0 = win->position.x;
+        labels[i].box.y0 = win->position.y;
+        labels[i].box.x1 = win->position.x + label_width;
+        labels[i].box.y1 = win->position.y + label_height;
+        i++;
+    }
+    qsort(labels, count, sizeof(Label), compare_labels);
+
+    Grid grid;
+    if (grid_init(&grid, label_width, label_height, count))
+    {
+        LOG("cannot separate labels\n");
+        free(labels);
+        free(items);
+        return;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        Label *label = &labels[i];
+        int right_edge = label->win->rect.x + label->win->rect.width;
+
+        // every move goes right or down past a placed label, so this ends
+        size_t attempt;
+        for (attempt = 0; attempt <= 2 * count; attempt++)
+        {
+            size_t num_near = grid_query(&grid, &label->box, items);
+            Box *blocker = NULL;
+            size_t n;
+            for (n = 0; n < num_near; n++)
+            {
+                Box *placed = &labels[items[n]].box;
+                if (boxes_overlap(&label->box, placed) && (blocker == NULL || placed->x1 > blocker->x1))
+                {
+                    blocker = placed;
+                }
+            }
+
+            if (blocker == NULL)
+            {
+                break;
+            }
+
+            if (blocker->x1 + label_width <= right_edge)
+            {
+                label->box.x0 = blocker->x1;
+            }
+            else
+            {
+                label->box.x0 = label->win->position.x;
+                label->box.y0 = blocker->y1;
+            }
+            label->box.x1 = label->box.x0 + label_width;
+            label->box.y1 = label->box.y0 + label_height;
+        }
+
+        if (label->box.x0 != label->win->position.x || label->box.y0 != label->win->position.y)
+        {
+            LOG("moving label (id: %lu, x: %i, y: %i)\n", label->win->id, label->box.x0, label->box.y0);
+            label->win->position.x = label->box.x0;
+            label->win->position.y = label->box.y0;
+        }
+
+        if (grid_insert(&grid, &label->box, i))
+        {
+            LOG("cannot separate labels\n");
+            break;
+        }
+    }
+
+    grid_free(&grid);
+    free(labels);
+    free(items);
+}
+
+/*
+ * Hidden windows are listed in columns from the right edge of their area,
+ * one per line with an empty line between workspaces.
+ */
+static void list_hidden_windows(Window *windows, int label_width, int label_height)
+{
+    int column_width = (label_width - 2) * HIDDEN_CAPTION_LENGTH + label_width;
+    int row = 0;
+    int column = 0;
+    const char *workspace = NULL;
+    Window *win;
+    for (win = windows; win != NULL; win = win->next)
+    {
+        if (!win->hidden)
+        {
+            continue;
+        }
+
+        int rows = win->rect.height / label_height;
+        rows = rows > 0 ? rows : 1;
+        if (row > 0 && workspace != NULL && win->workspace != NULL && strcmp(workspace, win->workspace) != 0)
+        {
+            row++;
+        }
+        if (row >= rows)
+        {
+            row = 0;
+            column++;
+        }
+
+        win->position.x = win->rect.x + win->rect.width - (column + 1) * column_width;
+        win->position.y = win->rect.y + row * label_height;
+        workspace = win->workspace;
+        row++;
+    }
+}
+
+void place_windows(Window *windows, int label_width, int label_height)
+{
+    separate_labels(windows, label_width, label_height);
+    list_hidden_windows(windows, label_width, label_height);
+}
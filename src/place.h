@@ -0,0 +1,9 @@
+#ifndef I3_EASYFOCUS_PLACE
+#define I3_EASYFOCUS_PLACE
+
+#include "win.h"
+
+Window *drop_occluded_windows(Window *windows);
+void place_windows(Window *windows, int label_width, int label_height);
+
+#endif
@@ -0,0 +1,179 @@
+#include "print.h"
+#include "util.h"
+#include "map.h"
+
+#include <json-glib/json-glib.h>
+
+/*
+ * Machine readable descriptions of windows, using what the walk already
+ * collected, so that scripts don't have to fetch and search the tree again.
+ * The labels are the ones assigned in map.c.
+ */
+
+static const char *window_type_name(WindowType type)
+{
+    switch (type)
+    {
+    case FOCUSED_WINDOW:
+        return "focused";
+    case URGENT_WINDOW:
+        return "urgent";
+    case UNFOCUSED_WINDOW:
+        return "unfocused";
+    }
+
+    return "unknown";
+}
+
+static void add_string_member(JsonBuilder *builder, const char *name, const char *value)
+{
+    json_builder_set_member_name(builder, name);
+    if (value == NULL)
+    {
+        json_builder_add_null_value(builder);
+    }
+    else
+    {
+        json_builder_add_string_value(builder, value);
+    }
+}
+
+static void add_int_member(JsonBuilder *builder, const char *name, gint64 value)
+{
+    json_builder_set_member_name(builder, name);
+    json_builder_add_int_value(builder, value);
+}
+
+static void add_window(JsonBuilder *builder, Window *win, int labeled)
+{
+    json_builder_begin_object(builder);
+    add_int_member(builder, "con_id", win->id);
+    add_int_member(builder, "window_id", win->win_id);
+
+    if (labeled)
+    {
+        xcb_keysym_t key = map_get_keysym(win);
+        add_string_member(builder, "label", key == XCB_NO_SYMBOL ? NULL : map_keysym_name(key));
+
+        json_builder_set_member_name(builder, "position");
+        json_builder_begin_object(builder);
+        add_int_member(builder, "x", win->position.x);
+        add_int_member(builder, "y", win->position.y);
+        json_builder_end_object(builder);
+    }
+
+    json_builder_set_member_name(builder, "rect");
+    json_builder_begin_object(builder);
+    add_int_member(builder, "x", win->rect.x);
+    add_int_member(builder, "y", win->rect.y);
+    add_int_member(builder, "width", win->rect.width);
+    add_int_member(builder, "height", win->rect.height);
+    json_builder_end_object(builder);
+
+    json_builder_set_member_name(builder, "deco");
+    json_builder_begin_object(builder);
+    add_int_member(builder, "x", win->deco.x);
+    add_int_member(builder, "y", win->deco.y);
+    json_builder_end_object(builder);
+
+    add_string_member(builder, "workspace", win->workspace);
+    add_string_member(builder, "output", win->output);
+    add_string_member(builder, "type", window_type_name(win->type));
+
+    json_builder_set_member_name(builder, "urgent");
+    json_builder_add_boolean_value(builder, win->type == URGENT_WINDOW);
+    json_builder_set_member_name(builder, "floating");
+    json_builder_add_boolean_value(builder, win->floating);
+    json_builder_set_member_name(builder, "hidden");
+    json_builder_add_boolean_value(builder, win->hidden);
+
+    add_string_member(builder, "title", win->title);
+    add_string_member(builder, "class", win->class_name);
+    add_string_member(builder, "instance", win->instance);
+    json_builder_end_object(builder);
+}
+
+static int print_json(FILE *out, JsonBuilder *builder)
+{
+    JsonNode *root = json_builder_get_root(builder);
+    JsonGenerator *generator = json_generator_new();
+    json_generator_set_root(generator, root);
+    gchar *data = json_generator_to_data(generator, NULL);
+
+    int failed = (fprintf(out, "%s\n", data) < 0);
+    if (failed)
+    {
+        LOG("cannot write json output\n");
+    }
+
+    g_free(data);
+    g_object_unref(generator);
+    json_node_unref(root);
+    return failed;
+}
+
+int print_window_json(FILE *out, Window *win)
+{
+    JsonBuilder *builder = json_builder_new();
+    add_window(builder, win, 0);
+    int failed = print_json(out, builder);
+    g_object_unref(builder);
+
+    return failed;
+}
+
+int print_labels_json(FILE *out, Window *windows)
+{
+    JsonBuilder *builder = json_builder_new();
+    json_builder_begin_array(builder);
+    Window *win;
+    for (win = windows; win != NULL; win = win->next)
+    {
+        add_window(builder, win, 1);
+    }
+    json_builder_end_array(builder);
+
+    int failed = print_json(out, builder);
+    g_object_unref(builder);
+
+    return failed;
+}
+
+static void print_tsv_field(FILE *out, const char *value)
+{
+    // fields must not break the columns or lines
+    for (; value != NULL && *value != '\0'; value++)
+    {
+        fputc(*value == '\t' || *value == '\n' ? ' ' : *value, out);
+    }
+}
+
+int print_labels_tsv(FILE *out, Window *windows)
+{
+    Window *win;
+    for (win = windows; win != NULL; win = win->next)
+    {
+        xcb_keysym_t key = map_get_keysym(win);
+        const char *label = key == XCB_NO_SYMBOL ? NULL : map_keysym_name(key);
+
+        fprintf(out, "%lu\t%u\t%s\t%i\t%i\t%s\t",
+                win->id,
+                win->win_id,
+                label != NULL ? label : "",
+                win->position.x,
+                win->position.y,
+                window_type_name(win->type));
+        print_tsv_field(out, win->workspace);
+        fputc('\t', out);
+        print_tsv_field(out, win->title);
+        fputc('\n', out);
+    }
+
+    if (fflush(out) != 0)
+    {
+        LOG("cannot write tsv output\n");
+        return 1;
+    }
+
+    return 0;
+}
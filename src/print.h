@@ -0,0 +1,11 @@
+#ifndef I3_EASYFOCUS_PRINT
+#define I3_EASYFOCUS_PRINT
+
+#include <stdio.h>
+#include "win.h"
+
+int print_window_json(FILE *out, Window *win);
+int print_labels_json(FILE *out, Window *windows);
+int print_labels_tsv(FILE *out, Window *windows);
+
+#endif
@@ -0,0 +1,18 @@
+#include "probes.h"
+
+#ifdef PROBES_AVAILABLE
+
+// tracers find the semaphores through the notes of the probes and count
+// themselves in while attached, see PROBE_ENABLED
+#define DEFINE_SEMAPHORE(name) volatile unsigned short PROBE_SEMAPHORE(name) __attribute__((section(".probes"))) = 0
+
+DEFINE_SEMAPHORE(walk_entry);
+DEFINE_SEMAPHORE(walk_exit);
+DEFINE_SEMAPHORE(request_check);
+DEFINE_SEMAPHORE(text_window_create);
+DEFINE_SEMAPHORE(text_window_expose);
+DEFINE_SEMAPHORE(key_press);
+DEFINE_SEMAPHORE(focus_send);
+DEFINE_SEMAPHORE(focus_reply);
+
+#endif
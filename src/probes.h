@@ -0,0 +1,61 @@
+#ifndef I3_EASYFOCUS_PROBES
+#define I3_EASYFOCUS_PROBES
+
+/*
+ * Static tracepoints for bpftrace, perf and systemtap, e.g.:
+ *
+ *   bpftrace -e 'usdt:./i3-easyfocus:i3_easyfocus:key_press { printf("%d\n", arg1); }'
+ *
+ * A probe is a single nop in the binary that a tracer replaces while it is
+ * attached, so they stay in release builds. Without sys/sdt.h (systemtap's
+ * sdt headers) they compile to nothing.
+ *
+ * Every probe has a semaphore, defined in src/probes.c, that tracers raise
+ * while they are attached. Arguments that take work to compute are only
+ * computed if PROBE_ENABLED(name) is true.
+ *
+ * Probes and their arguments:
+ *   walk_entry          search area, containers in the tree
+ *   walk_exit           windows found
+ *   request_check       sequence number, X error code or 0
+ *   text_window_create  label window, x, y
+ *   text_window_expose  label window
+ *   key_press           keycode, keysym, server time
+ *   focus_send          con id, window id
+ *   focus_reply         con id, 1 if i3 reported an error
+ */
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#define PROBES_AVAILABLE 1
+#endif
+#endif
+
+#ifdef PROBES_AVAILABLE
+#define PROBE_SEMAPHORE(name) i3_easyfocus_##name##_semaphore
+#define PROBE_ENABLED(name) __builtin_expect(PROBE_SEMAPHORE(name) != 0, 0)
+
+extern volatile unsigned short PROBE_SEMAPHORE(walk_entry);
+extern volatile unsigned short PROBE_SEMAPHORE(walk_exit);
+extern volatile unsigned short PROBE_SEMAPHORE(request_check);
+extern volatile unsigned short PROBE_SEMAPHORE(text_window_create);
+extern volatile unsigned short PROBE_SEMAPHORE(text_window_expose);
+extern volatile unsigned short PROBE_SEMAPHORE(key_press);
+extern volatile unsigned short PROBE_SEMAPHORE(focus_send);
+extern volatile unsigned short PROBE_SEMAPHORE(focus_reply);
+
+#define PROBE(name) DTRACE_PROBE(i3_easyfocus, name)
+#define PROBE1(name, a) DTRACE_PROBE1(i3_easyfocus, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(i3_easyfocus, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(i3_easyfocus, name, a, b, c)
+#else
+#define PROBE_ENABLED(name) 0
+#define PROBE(name) do {} while (0)
+#define PROBE1(name, a) do {} while (0)
+#define PROBE2(name, a, b) do {} while (0)
+#define PROBE3(name, a, b, c) do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,165 @@
+#include "record.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <time.h>
+
+/*
+ * Writes a session as JSON lines, for bench/replay-i3 to play back: the
+ * requests sent to i3 with their replies, the events i3 sent, and the X
+ * events that reached the main loop. Every line has the monotonic time it
+ * happened at, IPC requests also how long i3 took to reply. The first line
+ * holds the command line the session was started with.
+ */
+
+static FILE *out = NULL;
+
+long long record_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void write_string(const char *s)
+{
+    if (s == NULL)
+    {
+        fputs("null", out);
+        return;
+    }
+
+    fputc('"', out);
+    for (; *s != '\0'; s++)
+    {
+        unsigned char c = (unsigned char) *s;
+        if (c == '"' || c == '\\')
+        {
+            fputc('\\', out);
+            fputc(c, out);
+        }
+        else if (c < 0x20)
+        {
+            fprintf(out, "\\u%04x", c);
+        }
+        else
+        {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+int record_init(const char *path, int argc, char *argv[])
+{
+    out = fopen(path, "w");
+    if (out == NULL)
+    {
+        LOG("cannot open recording: %s\n", path);
+        return 1;
+    }
+
+    fprintf(out, "{\"t_ns\":%lld,\"argv\":[", record_now());
+    int i;
+    for (i = 0; i < argc; i++)
+    {
+        if (i > 0)
+        {
+            fputc(',', out);
+        }
+        write_string(argv[i]);
+    }
+    fputs("]}\n", out);
+
+    return 0;
+}
+
+int record_enabled()
+{
+    return out != NULL;
+}
+
+void record_ipc(const char *type, const char *request, const char *reply, long long start_ns)
+{
+    if (out == NULL)
+    {
+        return;
+    }
+
+    // the tree is fetched on its own thread, lines must not interleave
+    long long end_ns = record_now();
+    flockfile(out);
+    fprintf(out, "{\"t_ns\":%lld,\"duration_ns\":%lld,\"ipc\":", start_ns, end_ns - start_ns);
+    write_string(type);
+    fputs(",\"request\":", out);
+    write_string(request);
+    // replies are JSON already
+    fprintf(out, ",\"reply\":%s}\n", reply != NULL ? reply : "null");
+    funlockfile(out);
+}
+
+void record_i3_event(const char *type, const char *change, unsigned long id, int urgent, const char *name)
+{
+    if (out == NULL)
+    {
+        return;
+    }
+
+    flockfile(out);
+    fprintf(out, "{\"t_ns\":%lld,\"event\":", record_now());
+    write_string(type);
+    fputs(",\"change\":", out);
+    write_string(change);
+    fprintf(out, ",\"id\":%lu,\"urgent\":%s,\"name\":", id, urgent ? "true" : "false");
+    write_string(name);
+    fputs("}\n", out);
+    funlockfile(out);
+}
+
+void record_key_press(const xcb_key_press_event_t *kp, xcb_keysym_t keysym)
+{
+    if (out == NULL)
+    {
+        return;
+    }
+
+    fprintf(out, "{\"t_ns\":%lld,\"x_event\":\"key_press\",\"keycode\":%u,\"state\":%u,\"keysym\":%u}\n",
+            record_now(), kp->detail, kp->state, keysym);
+}
+
+void record_x_event(const xcb_generic_event_t *event)
+{
+    if (out == NULL)
+    {
+        return;
+    }
+
+    switch (event->response_type & ~0x80)
+    {
+    case XCB_CONFIGURE_NOTIFY:
+    {
+        const xcb_configure_notify_event_t *cn = (const xcb_configure_notify_event_t *) event;
+        fprintf(out, "{\"t_ns\":%lld,\"x_event\":\"configure_notify\",\"window\":%u,\"x\":%d,\"y\":%d,\"width\":%u,\"height\":%u}\n",
+                record_now(), cn->window, cn->x, cn->y, cn->width, cn->height);
+        break;
+    }
+    case XCB_FOCUS_IN:
+    case XCB_FOCUS_OUT:
+    {
+        const xcb_focus_in_event_t *fe = (const xcb_focus_in_event_t *) event;
+        fprintf(out, "{\"t_ns\":%lld,\"x_event\":\"%s\",\"window\":%u,\"mode\":%u}\n",
+                record_now(), (event->response_type & ~0x80) == XCB_FOCUS_IN ? "focus_in" : "focus_out", fe->event, fe->mode);
+        break;
+    }
+    }
+}
+
+void record_finish()
+{
+    if (out != NULL)
+    {
+        fclose(out);
+    }
+
+    out = NULL;
+}
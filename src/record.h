@@ -0,0 +1,15 @@
+#ifndef I3_EASYFOCUS_RECORD
+#define I3_EASYFOCUS_RECORD
+
+#include <xcb/xcb.h>
+
+int record_init(const char *path, int argc, char *argv[]);
+int record_enabled();
+long long record_now();
+void record_ipc(const char *type, const char *request, const char *reply, long long start_ns);
+void record_i3_event(const char *type, const char *change, unsigned long id, int urgent, const char *name);
+void record_key_press(const xcb_key_press_event_t *kp, xcb_keysym_t keysym);
+void record_x_event(const xcb_generic_event_t *event);
+void record_finish();
+
+#endif
@@ -0,0 +1,177 @@
+#include "stable.h"
+#include "cache.h"
+#include "config.h"
+#include "map.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Remembers which key each window had, so that --stable can give it the
+ * same one again. Entries are ordered by recency and each con id and window
+ * id appears at most once, so a lookup has a single answer. Several windows
+ * may remember the same key; which of them gets it is decided when the keys
+ * are assigned. Con ids change when i3 restarts, the X window id is used
+ * then. Once the table is full, the least recently labelled window is
+ * forgotten.
+ */
+
+#define STABLE_FILE_NAME "labels"
+#define STABLE_MAX_LINE 64
+
+typedef struct stable_entry
+{
+    unsigned long id;
+    uint32_t win_id;
+    xcb_keysym_t keysym;
+} StableEntry;
+
+static StableEntry entries[STABLE_MAX_ENTRIES];
+static size_t num_entries = 0;
+
+int stable_load()
+{
+    num_entries = 0;
+
+    char path[CACHE_MAX_PATH];
+    if (cache_file_path(STABLE_FILE_NAME, 0, path, sizeof(path)))
+    {
+        return 1;
+    }
+
+    FILE *in = fopen(path, "r");
+    if (in == NULL)
+    {
+        LOG("no stable labels at %s\n", path);
+        return 1;
+    }
+
+    char line[STABLE_MAX_LINE];
+    while (num_entries < STABLE_MAX_ENTRIES && fgets(line, sizeof(line), in) != NULL)
+    {
+        unsigned long id;
+        unsigned int win_id;
+        char name[16];
+        if (sscanf(line, "%lu\t%u\t%15s", &id, &win_id, name) != 3)
+        {
+            continue;
+        }
+
+        xcb_keysym_t keysym = map_keysym_from_name(name);
+        if (keysym != XCB_NO_SYMBOL)
+        {
+            entries[num_entries].id = id;
+            entries[num_entries].win_id = win_id;
+            entries[num_entries].keysym = keysym;
+            num_entries++;
+        }
+    }
+
+    fclose(in);
+    return 0;
+}
+
+static xcb_keysym_t entry_key(size_t i, size_t *age)
+{
+    if (age != NULL)
+    {
+        *age = i;
+    }
+
+    return entries[i].keysym;
+}
+
+// age, if not NULL, is set to the entry's position, 0 for the latest one
+xcb_keysym_t stable_key(Window *win, size_t *age)
+{
+    size_t i;
+    for (i = 0; i < num_entries; i++)
+    {
+        if (entries[i].id == win->id)
+        {
+            return entry_key(i, age);
+        }
+    }
+
+    for (i = 0; i < num_entries; i++)
+    {
+        if (win->win_id != 0 && entries[i].win_id == win->win_id)
+        {
+            return entry_key(i, age);
+        }
+    }
+
+    return XCB_NO_SYMBOL;
+}
+
+void stable_remember(Window *win, xcb_keysym_t keysym)
+{
+    if (keysym == XCB_NO_SYMBOL)
+    {
+        return;
+    }
+
+    // only the window loses its older entry, other windows keep the key
+    size_t i, kept = 0;
+    for (i = 0; i < num_entries; i++)
+    {
+        StableEntry *e = &entries[i];
+        if (e->id != win->id && (win->win_id == 0 || e->win_id != win->win_id))
+        {
+            entries[kept++] = *e;
+        }
+    }
+    num_entries = kept < STABLE_MAX_ENTRIES ? kept : STABLE_MAX_ENTRIES - 1;
+
+    memmove(&entries[1], &entries[0], num_entries * sizeof(StableEntry));
+    entries[0].id = win->id;
+    entries[0].win_id = win->win_id;
+    entries[0].keysym = keysym;
+    num_entries++;
+}
+
+int stable_store()
+{
+    char path[CACHE_MAX_PATH];
+    char tmp[CACHE_MAX_PATH + 16];
+    if (cache_file_path(STABLE_FILE_NAME, 1, path, sizeof(path)))
+    {
+        return 1;
+    }
+
+    // written next to the table and renamed, so readers never see half a file
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int) getpid());
+    FILE *out = fopen(tmp, "w");
+    if (out == NULL)
+    {
+        LOG("cannot write stable labels %s\n", tmp);
+        return 1;
+    }
+
+    size_t i;
+    for (i = 0; i < num_entries; i++)
+    {
+        const char *name = map_keysym_name(entries[i].keysym);
+        if (name != NULL)
+        {
+            fprintf(out, "%lu\t%u\t%s\n", entries[i].id, entries[i].win_id, name);
+        }
+    }
+
+    if (fclose(out) != 0 || rename(tmp, path) != 0)
+    {
+        LOG("cannot write stable labels %s\n", path);
+        unlink(tmp);
+        return 1;
+    }
+
+    return 0;
+}
+
+void stable_free()
+{
+    num_entries = 0;
+}
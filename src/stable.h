@@ -0,0 +1,13 @@
+#ifndef I3_EASYFOCUS_STABLE
+#define I3_EASYFOCUS_STABLE
+
+#include <xcb/xcb.h>
+#include "win.h"
+
+int stable_load();
+xcb_keysym_t stable_key(Window *win, size_t *age);
+void stable_remember(Window *win, xcb_keysym_t keysym);
+int stable_store();
+void stable_free();
+
+#endif
@@ -0,0 +1,199 @@
+#include "trace.h"
+#include "util.h"
+#include "config.h"
+
+#include <stdio.h>
+#include <time.h>
+
+#define MAX_DEPTH 16
+
+typedef struct span
+{
+    TracePhase phase;
+    long long start_ns;
+    unsigned long x_round_trips;
+    unsigned long ipc_messages;
+    unsigned long items;
+    int cached; // the phase was served from the cache of src/cache.c
+} Span;
+
+typedef struct budget
+{
+    unsigned long x_round_trips;
+    unsigned long x_round_trips_cached;
+    unsigned long x_round_trips_per_item;
+    unsigned long ipc_messages;
+} Budget;
+
+static const Budget budgets[TRACE_PHASE_COUNT] = TRACE_BUDGETS;
+
+static const char *phase_names[TRACE_PHASE_COUNT] = {
+    "ipc_init",
+    "get_tree",
+    "visibility",
+    "placement",
+    "xcb_init",
+    "key_grabs",
+    "labels",
+    "first_expose",
+    "key_press",
+    "focus"};
+
+static FILE *out = NULL;
+static unsigned long phases_over_budget = 0;
+
+// spans nest per thread, so that phases running concurrently don't mix
+static __thread Span spans[MAX_DEPTH];
+static __thread int depth = 0;
+
+static long long monotonic_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int trace_init(const char *path)
+{
+    if (path == NULL)
+    {
+        out = stderr;
+        return 0;
+    }
+
+    out = fopen(path, "w");
+    if (out == NULL)
+    {
+        LOG("cannot open trace file: %s\n", path);
+        return 1;
+    }
+
+    return 0;
+}
+
+void trace_begin(TracePhase phase)
+{
+    if (out == NULL)
+    {
+        return;
+    }
+
+    if (depth >= MAX_DEPTH)
+    {
+        LOG("trace spans nested too deeply, ignoring '%s'\n", phase_names[phase]);
+        depth++;
+        return;
+    }
+
+    Span *span = &spans[depth++];
+    span->phase = phase;
+    span->start_ns = monotonic_ns();
+    span->x_round_trips = 0;
+    span->ipc_messages = 0;
+    span->items = 0;
+    span->cached = 0;
+}
+
+void trace_end(TracePhase phase)
+{
+    if (out == NULL || depth == 0)
+    {
+        return;
+    }
+
+    depth--;
+    if (depth >= MAX_DEPTH)
+    {
+        return;
+    }
+
+    Span *span = &spans[depth];
+    if (span->phase != phase)
+    {
+        LOG("trace span mismatch: ending '%s' while '%s' is open\n", phase_names[phase], phase_names[span->phase]);
+    }
+
+    const Budget *budget = &budgets[span->phase];
+    unsigned long x_budget = (span->cached ? budget->x_round_trips_cached : budget->x_round_trips) +
+                             budget->x_round_trips_per_item * span->items;
+    int over_budget = (span->x_round_trips > x_budget || span->ipc_messages > budget->ipc_messages);
+
+    long long end_ns = monotonic_ns();
+    fprintf(out,
+            "{\"phase\":\"%s\",\"depth\":%d,\"start_ns\":%lld,\"end_ns\":%lld,\"duration_ns\":%lld,\"x_round_trips\":%lu,\"ipc_messages\":%lu,"
+            "\"items\":%lu,\"cached\":%s,\"x_round_trip_budget\":%lu,\"ipc_message_budget\":%lu,\"over_budget\":%s}\n",
+            phase_names[span->phase],
+            depth,
+            span->start_ns,
+            end_ns,
+            end_ns - span->start_ns,
+            span->x_round_trips,
+            span->ipc_messages,
+            span->items,
+            span->cached ? "true" : "false",
+            x_budget,
+            budget->ipc_messages,
+            over_budget ? "true" : "false");
+    fflush(out);
+
+    if (over_budget)
+    {
+        phases_over_budget++;
+        fprintf(stderr, "trace: phase '%s' over budget (x round trips: %lu of %lu, ipc messages: %lu of %lu), see TRACE_BUDGETS in src/config.h\n",
+                phase_names[span->phase],
+                span->x_round_trips,
+                x_budget,
+                span->ipc_messages,
+                budget->ipc_messages);
+    }
+}
+
+void trace_x_round_trip()
+{
+    int i;
+    for (i = 0; i < depth && i < MAX_DEPTH; i++)
+    {
+        spans[i].x_round_trips++;
+    }
+}
+
+void trace_ipc_message()
+{
+    int i;
+    for (i = 0; i < depth && i < MAX_DEPTH; i++)
+    {
+        spans[i].ipc_messages++;
+    }
+}
+
+void trace_items(unsigned long count)
+{
+    int i;
+    for (i = 0; i < depth && i < MAX_DEPTH; i++)
+    {
+        spans[i].items += count;
+    }
+}
+
+void trace_cached()
+{
+    if (depth > 0 && depth <= MAX_DEPTH)
+    {
+        spans[depth - 1].cached = 1;
+    }
+}
+
+unsigned long trace_finish()
+{
+    if (out != NULL && out != stderr)
+    {
+        fclose(out);
+    }
+
+    out = NULL;
+    depth = 0;
+
+    unsigned long over_budget = phases_over_budget;
+    phases_over_budget = 0;
+    return over_budget;
+}
@@ -0,0 +1,28 @@
+#ifndef I3_EASYFOCUS_TRACE
+#define I3_EASYFOCUS_TRACE
+
+typedef enum {
+    TRACE_IPC_INIT,
+    TRACE_GET_TREE,
+    TRACE_VISIBILITY,
+    TRACE_PLACEMENT,
+    TRACE_XCB_INIT,
+    TRACE_KEY_GRABS,
+    TRACE_LABELS,
+    TRACE_FIRST_EXPOSE,
+    TRACE_KEY_PRESS,
+    TRACE_FOCUS,
+
+    TRACE_PHASE_COUNT
+} TracePhase;
+
+int trace_init(const char *path);
+void trace_begin(TracePhase phase);
+void trace_end(TracePhase phase);
+void trace_x_round_trip();
+void trace_ipc_message();
+void trace_items(unsigned long count);
+void trace_cached();
+unsigned long trace_finish();
+
+#endif
@@ -0,0 +1,412 @@
+#include "tree.h"
+#include "util.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * A copy of i3's layout tree, built straight from the JSON of GET_TREE and
+ * kept up to date with the focus, urgency and title changes that i3 reports
+ * as events. Changes to the structure or geometry are not applied, as i3
+ * doesn't report how they affect the other containers; the tree has to be
+ * fetched again after those.
+ */
+
+static JsonNode *member(JsonObject *obj, const char *name)
+{
+    JsonNode *node = json_object_get_member(obj, name);
+    return (node == NULL || json_node_is_null(node)) ? NULL : node;
+}
+
+static gint64 int_member(JsonObject *obj, const char *name, gint64 fallback)
+{
+    JsonNode *node = member(obj, name);
+    return node == NULL ? fallback : json_node_get_int(node);
+}
+
+static char *string_member(JsonObject *obj, const char *name)
+{
+    JsonNode *node = member(obj, name);
+    const char *value = node == NULL ? NULL : json_node_get_string(node);
+    return value == NULL ? NULL : strdup(value);
+}
+
+static ConRect rect_member(JsonObject *obj, const char *name)
+{
+    ConRect rect = {0, 0, 0, 0};
+    JsonNode *node = member(obj, name);
+    if (node != NULL)
+    {
+        JsonObject *rect_obj = json_node_get_object(node);
+        rect.x = int_member(rect_obj, "x", 0);
+        rect.y = int_member(rect_obj, "y", 0);
+        rect.width = int_member(rect_obj, "width", 0);
+        rect.height = int_member(rect_obj, "height", 0);
+    }
+
+    return rect;
+}
+
+static ConType parse_type(const char *type)
+{
+    if (type == NULL)
+        return CON_CON;
+    if (strcmp(type, "root") == 0)
+        return CON_ROOT;
+    if (strcmp(type, "output") == 0)
+        return CON_OUTPUT;
+    if (strcmp(type, "floating_con") == 0)
+        return CON_FLOATING_CON;
+    if (strcmp(type, "workspace") == 0)
+        return CON_WORKSPACE;
+    if (strcmp(type, "dockarea") == 0)
+        return CON_DOCKAREA;
+    return CON_CON;
+}
+
+static ConLayout parse_layout(const char *layout)
+{
+    if (layout == NULL)
+        return LAYOUT_UNKNOWN;
+    if (strcmp(layout, "splith") == 0)
+        return LAYOUT_SPLITH;
+    if (strcmp(layout, "splitv") == 0)
+        return LAYOUT_SPLITV;
+    if (strcmp(layout, "stacked") == 0)
+        return LAYOUT_STACKED;
+    if (strcmp(layout, "tabbed") == 0)
+        return LAYOUT_TABBED;
+    if (strcmp(layout, "dockarea") == 0)
+        return LAYOUT_DOCKAREA;
+    if (strcmp(layout, "output") == 0)
+        return LAYOUT_OUTPUT;
+    return LAYOUT_UNKNOWN;
+}
+
+static void con_free(Con *con)
+{
+    size_t i;
+    for (i = 0; i < con->num_nodes; i++)
+    {
+        con_free(con->nodes[i]);
+    }
+    for (i = 0; i < con->num_floating_nodes; i++)
+    {
+        con_free(con->floating_nodes[i]);
+    }
+
+    free(con->nodes);
+    free(con->floating_nodes);
+    free(con->focus);
+    free(con->name);
+    free(con->class_name);
+    free(con->instance);
+    free(con);
+}
+
+static Con *con_from_json(Tree *tree, JsonObject *obj, Con *parent);
+
+static int children_from_json(Tree *tree, Con *con, JsonObject *obj, const char *name, Con ***children, size_t *count)
+{
+    JsonNode *node = member(obj, name);
+    JsonArray *array = node == NULL ? NULL : json_node_get_array(node);
+    size_t length = array == NULL ? 0 : json_array_get_length(array);
+    if (length == 0)
+    {
+        return 0;
+    }
+
+    *children = calloc(length, sizeof(Con *));
+    if (*children == NULL)
+    {
+        return 1;
+    }
+
+    size_t i;
+    for (i = 0; i < length; i++)
+    {
+        Con *child = con_from_json(tree, json_array_get_object_element(array, i), con);
+        if (child == NULL)
+        {
+            return 1;
+        }
+
+        (*children)[(*count)++] = child;
+    }
+
+    return 0;
+}
+
+static int focus_from_json(Con *con, JsonObject *obj)
+{
+    JsonNode *node = member(obj, "focus");
+    JsonArray *array = node == NULL ? NULL : json_node_get_array(node);
+    size_t length = array == NULL ? 0 : json_array_get_length(array);
+    if (length == 0)
+    {
+        return 0;
+    }
+
+    con->focus = malloc(sizeof(unsigned long) * length);
+    if (con->focus == NULL)
+    {
+        return 1;
+    }
+
+    size_t i;
+    for (i = 0; i < length; i++)
+    {
+        con->focus[i] = (unsigned long) json_array_get_int_element(array, i);
+    }
+    con->num_focus = length;
+
+    return 0;
+}
+
+static Con *con_from_json(Tree *tree, JsonObject *obj, Con *parent)
+{
+    Con *con = calloc(1, sizeof(Con));
+    if (con == NULL)
+    {
+        return NULL;
+    }
+
+    con->id = (unsigned long) int_member(obj, "id", 0);
+    con->window = (uint32_t) int_member(obj, "window", 0);
+    con->num = (int) int_member(obj, "num", -1);
+    con->parent = parent;
+    con->name = string_member(obj, "name");
+
+    JsonNode *type = member(obj, "type");
+    con->type = parse_type(type == NULL ? NULL : json_node_get_string(type));
+    JsonNode *layout = member(obj, "layout");
+    con->layout = parse_layout(layout == NULL ? NULL : json_node_get_string(layout));
+
+    JsonNode *flag = member(obj, "focused");
+    con->focused = flag != NULL && json_node_get_boolean(flag);
+    flag = member(obj, "urgent");
+    con->urgent = flag != NULL && json_node_get_boolean(flag);
+    con->fullscreen = int_member(obj, "fullscreen_mode", 0) != 0;
+
+    con->rect = rect_member(obj, "rect");
+    con->deco_rect = rect_member(obj, "deco_rect");
+
+    JsonNode *properties = member(obj, "window_properties");
+    if (properties != NULL)
+    {
+        con->class_name = string_member(json_node_get_object(properties), "class");
+        con->instance = string_member(json_node_get_object(properties), "instance");
+    }
+
+    g_hash_table_insert(tree->index, GSIZE_TO_POINTER(con->id), con);
+    if (con->focused)
+    {
+        tree->focused = con;
+    }
+
+    if (focus_from_json(con, obj) ||
+        children_from_json(tree, con, obj, "nodes", &con->nodes, &con->num_nodes) ||
+        children_from_json(tree, con, obj, "floating_nodes", &con->floating_nodes, &con->num_floating_nodes))
+    {
+        LOG("cannot allocate con (id: %lu)\n", con->id);
+        con_free(con);
+        return NULL;
+    }
+
+    size_t i;
+    for (i = 0; i < con->num_nodes; i++)
+    {
+        con->num_descendants += con->nodes[i]->num_descendants + 1;
+    }
+    for (i = 0; i < con->num_floating_nodes; i++)
+    {
+        con->num_descendants += con->floating_nodes[i]->num_descendants + 1;
+    }
+
+    return con;
+}
+
+Tree *tree_from_json(JsonObject *root)
+{
+    Tree *tree = calloc(1, sizeof(Tree));
+    if (tree == NULL)
+    {
+        return NULL;
+    }
+
+    tree->index = g_hash_table_new(g_direct_hash, g_direct_equal);
+    tree->root = con_from_json(tree, root, NULL);
+    if (tree->root == NULL)
+    {
+        tree_free(tree);
+        return NULL;
+    }
+
+    return tree;
+}
+
+Tree *tree_parse(const char *json)
+{
+    GError *err = NULL;
+    JsonParser *parser = json_parser_new();
+    if (!json_parser_load_from_data(parser, json, -1, &err))
+    {
+        LOG("cannot parse tree: %s\n", err->message);
+        g_error_free(err);
+        g_object_unref(parser);
+        return NULL;
+    }
+
+    JsonNode *root = json_parser_get_root(parser);
+    Tree *tree = root == NULL ? NULL : tree_from_json(json_node_get_object(root));
+    g_object_unref(parser);
+
+    return tree;
+}
+
+Con *tree_find(Tree *tree, unsigned long id)
+{
+    return g_hash_table_lookup(tree->index, GSIZE_TO_POINTER(id));
+}
+
+Con *con_workspace(Con *con)
+{
+    for (; con != NULL; con = con->parent)
+    {
+        if (con->type == CON_WORKSPACE)
+        {
+            return con;
+        }
+    }
+
+    return NULL;
+}
+
+Con *con_output(Con *con)
+{
+    for (; con != NULL; con = con->parent)
+    {
+        if (con->type == CON_OUTPUT)
+        {
+            return con;
+        }
+    }
+
+    return NULL;
+}
+
+static void move_focus_to_front(Con *con, unsigned long id)
+{
+    size_t i;
+    for (i = 0; i < con->num_focus && con->focus[i] != id; i++)
+    {
+    }
+
+    if (i == con->num_focus)
+    {
+        return;
+    }
+
+    memmove(con->focus + 1, con->focus, sizeof(unsigned long) * i);
+    con->focus[0] = id;
+}
+
+static void focus_con(Tree *tree, Con *con)
+{
+    Con *curr;
+    for (curr = con; curr->parent != NULL; curr = curr->parent)
+    {
+        move_focus_to_front(curr->parent, curr->id);
+    }
+
+    if (tree->focused != NULL)
+    {
+        tree->focused->focused = 0;
+    }
+    con->focused = 1;
+    tree->focused = con;
+}
+
+/*
+ * Focuses the con like i3 does: it becomes the most recently focused child
+ * of all its ancestors. Returns 1 if the con is not in the tree.
+ */
+int tree_focus(Tree *tree, unsigned long id)
+{
+    Con *con = tree_find(tree, id);
+    if (con == NULL)
+    {
+        LOG("cannot focus unknown con (id: %lu)\n", id);
+        return 1;
+    }
+
+    focus_con(tree, con);
+    return 0;
+}
+
+/*
+ * Switching to a workspace focuses its most recently focused descendant.
+ */
+int tree_focus_workspace(Tree *tree, unsigned long id)
+{
+    Con *con = tree_find(tree, id);
+    if (con == NULL)
+    {
+        LOG("cannot focus unknown workspace (id: %lu)\n", id);
+        return 1;
+    }
+
+    while (con->num_focus > 0)
+    {
+        Con *child = tree_find(tree, con->focus[0]);
+        if (child == NULL)
+        {
+            LOG("focus stack of con %lu refers to unknown con\n", con->id);
+            return 1;
+        }
+        con = child;
+    }
+
+    focus_con(tree, con);
+    return 0;
+}
+
+int tree_set_urgent(Tree *tree, unsigned long id, int urgent)
+{
+    Con *con = tree_find(tree, id);
+    if (con == NULL)
+    {
+        return 1;
+    }
+
+    con->urgent = urgent;
+    return 0;
+}
+
+int tree_set_name(Tree *tree, unsigned long id, const char *name)
+{
+    Con *con = tree_find(tree, id);
+    if (con == NULL)
+    {
+        return 1;
+    }
+
+    free(con->name);
+    con->name = name == NULL ? NULL : strdup(name);
+    return 0;
+}
+
+void tree_free(Tree *tree)
+{
+    if (tree == NULL)
+    {
+        return;
+    }
+
+    if (tree->root != NULL)
+    {
+        con_free(tree->root);
+    }
+    g_hash_table_destroy(tree->index);
+    free(tree);
+}
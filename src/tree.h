@@ -0,0 +1,79 @@
+#ifndef I3_EASYFOCUS_TREE
+#define I3_EASYFOCUS_TREE
+
+#include <stdint.h>
+#include <stddef.h>
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+typedef enum {
+    CON_ROOT,
+    CON_OUTPUT,
+    CON_CON,
+    CON_FLOATING_CON,
+    CON_WORKSPACE,
+    CON_DOCKAREA
+} ConType;
+
+typedef enum {
+    LAYOUT_SPLITH,
+    LAYOUT_SPLITV,
+    LAYOUT_STACKED,
+    LAYOUT_TABBED,
+    LAYOUT_DOCKAREA,
+    LAYOUT_OUTPUT,
+    LAYOUT_UNKNOWN
+} ConLayout;
+
+typedef struct con_rect
+{
+    int x;
+    int y;
+    int width;
+    int height;
+} ConRect;
+
+typedef struct con
+{
+    unsigned long id;
+    uint32_t window;
+    ConType type;
+    ConLayout layout;
+    char *name;
+    char *class_name;
+    char *instance;
+    int num;
+    int focused;
+    int urgent;
+    int fullscreen;
+    ConRect rect;
+    ConRect deco_rect;
+    struct con *parent;
+    struct con **nodes;
+    size_t num_nodes;
+    struct con **floating_nodes;
+    size_t num_floating_nodes;
+    unsigned long *focus; // ids of the children, most recently focused first
+    size_t num_focus;
+    size_t num_descendants; // cons below this one, the structure isn't updated
+} Con;
+
+typedef struct tree
+{
+    Con *root;
+    Con *focused;
+    GHashTable *index; // con id to con
+} Tree;
+
+Tree *tree_parse(const char *json);
+Tree *tree_from_json(JsonObject *root);
+Con *tree_find(Tree *tree, unsigned long id);
+Con *con_workspace(Con *con);
+Con *con_output(Con *con);
+int tree_focus(Tree *tree, unsigned long id);
+int tree_focus_workspace(Tree *tree, unsigned long id);
+int tree_set_urgent(Tree *tree, unsigned long id, int urgent);
+int tree_set_name(Tree *tree, unsigned long id, const char *name);
+void tree_free(Tree *tree);
+
+#endif
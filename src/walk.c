@@ -0,0 +1,770 @@
+#include "walk.h"
+#include "util.h"
+#include "config.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <regex.h>
+#include <limits.h>
+#include <pthread.h>
+
+// each walking thread copies the strings of its windows into a block of its
+// own, so that the threads don't contend for the allocator
+static __thread WindowStrings *strings = NULL;
+
+static size_t string_size(const char *string)
+{
+    return string != NULL ? strlen(string) + 1 : 0;
+}
+
+static Window *con_to_window(Con *con)
+{
+    int x, y;
+    int top = con->rect.y;
+    if (con->fullscreen || (con->deco_rect.height == 0) || (con->parent == NULL))
+    {
+        x = con->rect.x;
+        y = con->rect.y;
+    }
+    else
+    {
+        x = con->parent->rect.x + con->deco_rect.x;
+        y = con->parent->rect.y + con->deco_rect.y;
+        top = (y < top ? y : top);
+    }
+
+    LOG("found window (id: %lu, window: %u, x: %i, y: %i)\n", con->id, con->window, x, y);
+    Window *window = malloc(sizeof(Window));
+    window->id = con->id;
+    window->win_id = con->window;
+    window->position.x = x;
+    window->position.y = y;
+    window->deco.x = x;
+    window->deco.y = y;
+    window->rect.x = con->rect.x;
+    window->rect.y = top;
+    window->rect.width = con->rect.width;
+    window->rect.height = con->rect.y + con->rect.height - top;
+    window->next = NULL;
+    window->is_tab = 0;
+    window->floating = 0;
+    window->hidden = 0;
+    window->stacking = 0;
+
+    Con *ws = con_workspace(con);
+    Con *output = con_output(con);
+    const char *ws_name = ws != NULL ? ws->name : NULL;
+    const char *output_name = output != NULL ? output->name : NULL;
+    window_reserve_strings(window, &strings,
+                           string_size(con->name) + string_size(con->class_name) + string_size(con->instance) +
+                               string_size(ws_name) + string_size(output_name));
+    window->title = window_copy_string(window, con->name);
+    window->class_name = window_copy_string(window, con->class_name);
+    window->instance = window_copy_string(window, con->instance);
+    window->workspace = window_copy_string(window, ws_name);
+    window->output = window_copy_string(window, output_name);
+    if (con->urgent) {
+        window->type = URGENT_WINDOW;
+    } else if (con->focused) {
+        window->type = FOCUSED_WINDOW;
+    } else {
+        window->type = UNFOCUSED_WINDOW;
+    }
+
+    return window;
+}
+
+// the focus stack also lists floating children, which are never the tab shown
+static unsigned long con_get_focused_tab_id(Con *con)
+{
+    size_t f, i;
+    for (f = 0; f < con->num_focus; f++)
+    {
+        for (i = 0; i < con->num_nodes; i++)
+        {
+            if (con->nodes[i]->id == con->focus[f])
+            {
+                return con->focus[f];
+            }
+        }
+    }
+
+    LOG("no tab in focus stack of con\n");
+    return 0;
+}
+
+static Con *con_find_fullscreen(Con *con)
+{
+    size_t i;
+    for (i = 0; i < con->num_nodes + con->num_floating_nodes; i++)
+    {
+        Con *child = i < con->num_nodes ? con->nodes[i] : con->floating_nodes[i - con->num_nodes];
+        if (child->fullscreen)
+        {
+            return child;
+        }
+
+        Con *found = con_find_fullscreen(child);
+        if (found != NULL)
+        {
+            return found;
+        }
+    }
+
+    return NULL;
+}
+
+static Con *con_get_visible_container(Con *con)
+{
+    LOG("find visible container in con '%lu'\n", con->id);
+
+    Con *target = con_find_fullscreen(con);
+    if (target != NULL)
+    {
+        LOG("con is in fullscreen mode\n");
+        return target;
+    }
+
+    return con;
+}
+
+static int regex_matches(regex_t *regex, const char *value)
+{
+    return regex == NULL || (value != NULL && regexec(regex, value, 0, NULL, 0) == 0);
+}
+
+static int criteria_set(const Criteria *criteria)
+{
+    return criteria != NULL &&
+           (criteria->class_name != NULL || criteria->instance != NULL || criteria->title != NULL ||
+            criteria->tiling || criteria->floating);
+}
+
+// tiling windows never contain floating ones, so whole subtrees can be skipped
+static int floating_excluded(int floating, const Criteria *criteria)
+{
+    return criteria != NULL && ((criteria->tiling && floating) || (criteria->floating && !floating));
+}
+
+/*
+ * A leaf matches if it is a window that satisfies all criteria, any other
+ * con if one of the windows below it does.
+ */
+static int con_matches(Con *con, int floating, const Criteria *criteria)
+{
+    if (!criteria_set(criteria))
+    {
+        return 1;
+    }
+
+    if (floating_excluded(floating, criteria))
+    {
+        return 0;
+    }
+
+    size_t num_children = con->num_nodes + con->num_floating_nodes;
+    if (num_children == 0)
+    {
+        return con->window != 0 &&
+               regex_matches(criteria->class_name, con->class_name) &&
+               regex_matches(criteria->instance, con->instance) &&
+               regex_matches(criteria->title, con->name);
+    }
+
+    size_t i;
+    for (i = 0; i < num_children; i++)
+    {
+        Con *child = i < con->num_nodes ? con->nodes[i] : con->floating_nodes[i - con->num_nodes];
+        if (con_matches(child, floating || i >= con->num_nodes, criteria))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int con_in_floating(Con *con)
+{
+    for (; con != NULL; con = con->parent)
+    {
+        if (con->type == CON_FLOATING_CON)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void mark_floating(Window *win)
+{
+    Window *curr;
+    for (curr = win; curr != NULL; curr = curr->next)
+    {
+        curr->floating = 1;
+    }
+}
+
+static Window **append_window(Window *win, Window **tail)
+{
+    *tail = win;
+    return &win->next;
+}
+
+/*
+ * Appends the visible windows below root to tail, which is returned moved to
+ * the new end of the list, so that the walk stays linear in the number of
+ * windows.
+ */
+static Window **append_visible_windows(Con *root, int floating, const Criteria *criteria, Window **tail)
+{
+    size_t num_children = root->num_nodes + root->num_floating_nodes;
+    if (num_children == 0)
+    {
+        // non-matching windows are skipped before anything is allocated
+        return con_matches(root, floating, criteria) ? append_window(con_to_window(root), tail) : tail;
+    }
+
+    size_t i;
+    if ((root->layout == LAYOUT_TABBED) ||
+        (root->layout == LAYOUT_STACKED))
+    {
+        unsigned long focus_id = con_get_focused_tab_id(root);
+        for (i = 0; i < root->num_nodes; i++)
+        {
+            Con *curr = root->nodes[i];
+            if (curr->id == focus_id)
+            {
+                Window **first = tail;
+                tail = append_visible_windows(curr, floating, criteria, tail);
+                if (tail == first)
+                {
+                    continue;
+                }
+
+                if ((*first)->id != curr->id)
+                {
+                    // the tab itself is labelled in front of its windows
+                    Window *tab = con_to_window(curr);
+                    tab->is_tab = 1;
+                    tab->next = *first;
+                    *first = tab;
+                }
+                else
+                {
+                    (*first)->is_tab = 1;
+                }
+            }
+            else
+            {
+                if (!con_matches(curr, floating, criteria))
+                {
+                    continue;
+                }
+
+                Window *win = con_to_window(curr);
+                win->is_tab = 1;
+                tail = append_window(win, tail);
+            }
+        }
+    }
+    else if ((root->layout == LAYOUT_SPLITH) ||
+             (root->layout == LAYOUT_SPLITV))
+    {
+        for (i = 0; i < root->num_nodes && !floating_excluded(floating, criteria); i++)
+        {
+            tail = append_visible_windows(root->nodes[i], floating, criteria, tail);
+        }
+    }
+    else
+    {
+        LOG("unknown layout of con: %lu\n", root->id);
+        return tail;
+    }
+
+    // floating nodes are not tabs, whatever the layout, and follow the tiling
+    // ones in stacking order
+    for (i = 0; i < root->num_floating_nodes && !floating_excluded(1, criteria); i++)
+    {
+        Window **first = tail;
+        tail = append_visible_windows(root->floating_nodes[i], 1, criteria, tail);
+        mark_floating(*first);
+    }
+
+    return tail;
+}
+
+static Window *visible_windows(Con *root, int floating, const Criteria *criteria)
+{
+    Window *res = NULL;
+    append_visible_windows(root, floating, criteria, &res);
+    return res;
+}
+
+static Window *visible_windows_on_curr_output(Tree *tree, const Criteria *criteria)
+{
+    Con *focused = tree->focused;
+    if (focused == NULL)
+    {
+        LOG("cannot find focused window\n");
+        return NULL;
+    }
+
+    Con *ws = con_workspace(focused);
+    ws = (ws == NULL ? focused : ws);
+
+    Con *con = con_get_visible_container(ws);
+    return visible_windows(con, con_in_floating(con), criteria);
+}
+
+static gint compare_rects(ConRect *a, ConRect *b)
+{
+    return a->y == b->y ? a->x - b->x : a->y - b->y;
+}
+
+// workspaces live in the content con of their output
+static Con *workspace_output(Con *ws)
+{
+    return ws->parent != NULL && ws->parent->parent != NULL ? ws->parent->parent : ws;
+}
+
+static gint compare_workspace_position(gconstpointer a, gconstpointer b)
+{
+    Con *output_a = workspace_output((Con *) a);
+    Con *output_b = workspace_output((Con *) b);
+
+    if (output_a == output_b)
+        return 0;
+
+    return compare_rects(&output_a->rect, &output_b->rect);
+}
+
+static gint compare_workspace_nums(gconstpointer a, gconstpointer b)
+{
+    return ((Con *) a)->num - ((Con *) b)->num;
+}
+
+/*
+ * The visible workspace of an output is the most recently focused one in its
+ * content con. Outputs starting with "__" hold i3's internal workspaces.
+ */
+static GSList *visible_workspaces(Tree *tree)
+{
+    GSList *workspaces = NULL;
+    size_t i, j;
+    for (i = 0; i < tree->root->num_nodes; i++)
+    {
+        Con *output = tree->root->nodes[i];
+        if (output->type != CON_OUTPUT || (output->name != NULL && strncmp(output->name, "__", 2) == 0))
+        {
+            continue;
+        }
+
+        for (j = 0; j < output->num_nodes; j++)
+        {
+            Con *content = output->nodes[j];
+            if (content->type != CON_CON || content->num_focus == 0)
+            {
+                continue;
+            }
+
+            Con *ws = tree_find(tree, content->focus[0]);
+            if (ws != NULL && ws->type == CON_WORKSPACE)
+            {
+                workspaces = g_slist_prepend(workspaces, ws);
+            }
+        }
+    }
+
+    return g_slist_reverse(workspaces);
+}
+
+static int max_threads = WALK_MAX_THREADS;
+
+void walk_set_max_threads(int threads)
+{
+    max_threads = threads > 0 ? threads : 1;
+}
+
+typedef struct walk_job
+{
+    Con **workspaces;
+    Window **results;
+    size_t count;
+    size_t next;
+    const Criteria *criteria;
+} WalkJob;
+
+// workers claim the next workspace until all are walked
+static void *walk_workspaces(void *data)
+{
+    WalkJob *job = data;
+    size_t i;
+    while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->count)
+    {
+        Con *con = con_get_visible_container(job->workspaces[i]);
+        job->results[i] = visible_windows(con, con_in_floating(con), job->criteria);
+    }
+
+    window_release_strings(&strings);
+    return NULL;
+}
+
+/*
+ * Walks the workspaces on up to max_threads threads, the calling one
+ * included. Each workspace's windows are collected in their own list, which
+ * are joined in the order of the workspaces, so the result is the same as
+ * walking them one after another.
+ */
+static int visible_windows_in_parallel(GSList *workspaces, size_t count, const Criteria *criteria, Window **res)
+{
+    Con **cons = malloc(count * sizeof(Con *));
+    Window **results = calloc(count, sizeof(Window *));
+    size_t num_threads = (size_t) max_threads < count ? (size_t) max_threads : count;
+    pthread_t *threads = malloc((num_threads - 1) * sizeof(pthread_t));
+    if (cons == NULL || results == NULL || threads == NULL)
+    {
+        LOG("cannot allocate parallel walk\n");
+        free(cons);
+        free(results);
+        free(threads);
+        return 1;
+    }
+
+    size_t i = 0;
+    const GSList *ws;
+    for (ws = workspaces; ws; ws = ws->next)
+    {
+        cons[i++] = ws->data;
+    }
+
+    WalkJob job = {cons, results, count, 0, criteria};
+    size_t started = 0;
+    for (i = 0; i + 1 < num_threads; i++)
+    {
+        // with fewer threads, the remaining ones take over the workspaces
+        if (pthread_create(&threads[started], NULL, walk_workspaces, &job) == 0)
+        {
+            started++;
+        }
+    }
+
+    walk_workspaces(&job);
+    for (i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    Window **tail = res;
+    for (i = 0; i < count; i++)
+    {
+        *tail = results[i];
+        while (*tail != NULL)
+        {
+            tail = &(*tail)->next;
+        }
+    }
+
+    free(threads);
+    free(results);
+    free(cons);
+
+    return 0;
+}
+
+static Window *visible_windows_on_all_outputs(Tree *tree, SortMethod sort_method, const Criteria *criteria)
+{
+    GSList *workspaces = visible_workspaces(tree);
+
+    if (sort_method == BY_NUMBER)
+    {
+        workspaces = g_slist_sort(workspaces, compare_workspace_nums);
+    }
+    else if (sort_method == BY_LOCATION)
+    {
+        workspaces = g_slist_sort(workspaces, compare_workspace_position);
+    }
+
+    // threads only pay off once the workspaces walked are large
+    Window *res = NULL;
+    size_t count = 0;
+    size_t cons = 0;
+    const GSList *ws;
+    for (ws = workspaces; ws; ws = ws->next)
+    {
+        count++;
+        cons += ((Con *) ws->data)->num_descendants + 1;
+    }
+
+    if (max_threads > 1 && count > 1 && cons >= WALK_PARALLEL_MIN_CONS &&
+        visible_windows_in_parallel(workspaces, count, criteria, &res) == 0)
+    {
+        g_slist_free(workspaces);
+        return res;
+    }
+
+    Window **tail = &res;
+    for (ws = workspaces; ws; ws = ws->next)
+    {
+        Con *con = con_get_visible_container(ws->data);
+        tail = append_visible_windows(con, con_in_floating(con), criteria, tail);
+    }
+
+    g_slist_free(workspaces);
+
+    return res;
+}
+
+static Window *visible_windows_in_curr_con(Tree *tree, const Criteria *criteria)
+{
+    Con *focused = tree->focused;
+    if (focused == NULL)
+    {
+        LOG("cannot find focused window\n");
+        return NULL;
+    }
+
+    Con *parent = focused->parent != NULL ? focused->parent : focused;
+    Con *con = con_get_visible_container(parent);
+
+    return visible_windows(con, con_in_floating(con), criteria);
+}
+
+/*
+ * Appends all windows below con to tail, which is returned moved to the new
+ * end of the list. Hidden windows are not on screen, so they are all placed
+ * on the area given and laid out in a list by place_windows.
+ */
+static Window **append_hidden_windows(Con *con, int floating, const Criteria *criteria, ConRect *area, Window **tail)
+{
+    size_t num_children = con->num_nodes + con->num_floating_nodes;
+    if (num_children == 0)
+    {
+        if (con->type == CON_WORKSPACE || !con_matches(con, floating, criteria))
+        {
+            return tail;
+        }
+
+        Window *win = con_to_window(con);
+        win->hidden = 1;
+        win->position.x = area->x;
+        win->position.y = area->y;
+        win->rect.x = area->x;
+        win->rect.y = area->y;
+        win->rect.width = area->width;
+        win->rect.height = area->height;
+
+        *tail = win;
+        return &win->next;
+    }
+
+    size_t i;
+    for (i = 0; i < num_children; i++)
+    {
+        Con *child = i < con->num_nodes ? con->nodes[i] : con->floating_nodes[i - con->num_nodes];
+        int child_floating = floating || i >= con->num_nodes;
+        if (!floating_excluded(child_floating, criteria))
+        {
+            tail = append_hidden_windows(child, child_floating, criteria, area, tail);
+        }
+    }
+
+    return tail;
+}
+
+static gint compare_con_nums(gconstpointer a, gconstpointer b)
+{
+    return ((Con *) a)->num - ((Con *) b)->num;
+}
+
+/*
+ * Labels the visible windows like --all does, followed by the windows on the
+ * hidden workspaces ordered by number, and finally the scratchpad.
+ */
+static Window *windows_everywhere(Tree *tree, SortMethod sort_method, const Criteria *criteria)
+{
+    Window *res = visible_windows_on_all_outputs(tree, sort_method, criteria);
+    Window **tail = &res;
+    while (*tail != NULL)
+    {
+        tail = &(*tail)->next;
+    }
+
+    Con *focused_output = tree->focused != NULL ? con_output(tree->focused) : NULL;
+    ConRect area = focused_output != NULL ? focused_output->rect : tree->root->rect;
+
+    GSList *hidden = NULL;
+    Con *scratchpad = NULL;
+    size_t i, j, k;
+    for (i = 0; i < tree->root->num_nodes; i++)
+    {
+        Con *output = tree->root->nodes[i];
+        for (j = 0; j < output->num_nodes; j++)
+        {
+            Con *content = output->nodes[j];
+            for (k = 0; k < content->num_nodes; k++)
+            {
+                Con *ws = content->nodes[k];
+                if (ws->type != CON_WORKSPACE)
+                {
+                    continue;
+                }
+
+                if (ws->name != NULL && strcmp(ws->name, "__i3_scratch") == 0)
+                {
+                    scratchpad = ws;
+                }
+                else if (content->num_focus == 0 || ws->id != content->focus[0])
+                {
+                    hidden = g_slist_prepend(hidden, ws);
+                }
+            }
+        }
+    }
+
+    hidden = g_slist_sort(g_slist_reverse(hidden), compare_con_nums);
+
+    GSList *ws;
+    for (ws = hidden; ws; ws = ws->next)
+    {
+        tail = append_hidden_windows(ws->data, 0, criteria, &area, tail);
+    }
+
+    if (scratchpad != NULL)
+    {
+        tail = append_hidden_windows(scratchpad, 0, criteria, &area, tail);
+    }
+
+    g_slist_free(hidden);
+
+    return res;
+}
+
+typedef struct proximity
+{
+    Window *win;
+    long long gap;
+    long long center;
+    size_t index;
+} Proximity;
+
+static long long axis_gap(int a, int a_size, int b, int b_size)
+{
+    if (a + a_size <= b)
+    {
+        return b - (a + a_size);
+    }
+
+    return b + b_size <= a ? a - (b + b_size) : 0;
+}
+
+static int compare_proximity(const void *a, const void *b)
+{
+    const Proximity *pa = a;
+    const Proximity *pb = b;
+    if (pa->gap != pb->gap)
+    {
+        return pa->gap < pb->gap ? -1 : 1;
+    }
+    if (pa->center != pb->center)
+    {
+        return pa->center < pb->center ? -1 : 1;
+    }
+
+    // keep the tree order for windows at the same distance
+    return pa->index < pb->index ? -1 : (pa->index > pb->index);
+}
+
+/*
+ * Orders the windows by the gap between them and the focused con, so that
+ * adjacent windows get the first keys. Ties are broken by the distance of
+ * the centers. The focused window itself and hidden windows, which are not
+ * on screen, go last.
+ */
+static Window *order_by_proximity(Window *windows, Con *focused)
+{
+    size_t count = 0;
+    Window *win;
+    for (win = windows; win != NULL; win = win->next)
+    {
+        count++;
+    }
+
+    if (focused == NULL || count < 2)
+    {
+        return windows;
+    }
+
+    Proximity *order = malloc(count * sizeof(Proximity));
+    if (order == NULL)
+    {
+        LOG("cannot allocate proximity order\n");
+        return windows;
+    }
+
+    ConRect *f = &focused->rect;
+    size_t i = 0;
+    for (win = windows; win != NULL; win = win->next, i++)
+    {
+        long long dx = axis_gap(win->rect.x, win->rect.width, f->x, f->width);
+        long long dy = axis_gap(win->rect.y, win->rect.height, f->y, f->height);
+        long long cx = (2LL * win->rect.x + win->rect.width) - (2LL * f->x + f->width);
+        long long cy = (2LL * win->rect.y + win->rect.height) - (2LL * f->y + f->height);
+
+        order[i].win = win;
+        order[i].gap = (win->hidden || win->id == focused->id) ? LLONG_MAX : dx * dx + dy * dy;
+        order[i].center = cx * cx + cy * cy;
+        order[i].index = i;
+    }
+
+    qsort(order, count, sizeof(Proximity), compare_proximity);
+
+    for (i = 0; i + 1 < count; i++)
+    {
+        order[i].win->next = order[i + 1].win;
+    }
+    order[count - 1].win->next = NULL;
+
+    windows = order[0].win;
+    free(order);
+
+    return windows;
+}
+
+Window *walk_visible_windows(Tree *tree, SearchArea search_area, SortMethod sort_method, const Criteria *criteria, LabelOrder order)
+{
+    Window *windows = NULL;
+    switch (search_area)
+    {
+    case CURRENT_OUTPUT:
+        windows = visible_windows_on_curr_output(tree, criteria);
+        break;
+    case ALL_OUTPUTS:
+        windows = visible_windows_on_all_outputs(tree, sort_method, criteria);
+        break;
+    case CURRENT_CONTAINER:
+        windows = visible_windows_in_curr_con(tree, criteria);
+        break;
+    case EVERYWHERE:
+        windows = windows_everywhere(tree, sort_method, criteria);
+        break;
+    }
+
+    // placement needs the stacking order after the windows were reordered
+    size_t stacking = 0;
+    Window *win;
+    for (win = windows; win != NULL; win = win->next)
+    {
+        win->stacking = stacking++;
+    }
+
+    if (order == ORDER_PROXIMITY)
+    {
+        windows = order_by_proximity(windows, tree->focused);
+    }
+
+    // the windows keep the block they use, the next walk starts a new one
+    window_release_strings(&strings);
+    return windows;
+}
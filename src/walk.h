@@ -0,0 +1,11 @@
+#ifndef I3_EASYFOCUS_WALK
+#define I3_EASYFOCUS_WALK
+
+#include "ipc.h"
+#include "tree.h"
+#include "win.h"
+
+void walk_set_max_threads(int threads);
+Window *walk_visible_windows(Tree *tree, SearchArea search_area, SortMethod sort_method, const Criteria *criteria, LabelOrder order);
+
+#endif
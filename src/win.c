@@ -1,6 +1,16 @@
 #include "win.h"
+#include "config.h"
 
 #include <stdlib.h>
+#include <string.h>
+
+struct window_strings
+{
+    size_t refs; // the windows using the block and whoever still copies into it
+    size_t used;
+    size_t capacity;
+    char data[];
+};
 
 Window *window_append(Window *win, Window *item)
 {
@@ -17,12 +27,94 @@ Window *window_append(Window *win, Window *item)
     return win;
 }
 
+size_t window_count(Window *win)
+{
+    size_t count = 0;
+    for (; win != NULL; win = win->next)
+    {
+        count++;
+    }
+
+    return count;
+}
+
 void window_free(Window *win)
 {
     while (win != NULL)
     {
         Window *tmp = win;
         win = win->next;
+        if (tmp->strings != NULL)
+        {
+            window_release_strings(&tmp->strings);
+        }
+        else
+        {
+            free(tmp->title);
+            free(tmp->class_name);
+            free(tmp->instance);
+            free(tmp->workspace);
+            free(tmp->output);
+        }
         free(tmp);
     }
 }
+
+/*
+ * Makes room for length bytes of the window's strings in the block, which is
+ * replaced by a new one when full. The window's strings are copied into the
+ * block with window_copy_string afterwards; if there is no memory for a new
+ * block, they are allocated one by one instead and 1 is returned.
+ */
+int window_reserve_strings(Window *win, WindowStrings **block, size_t length)
+{
+    win->strings = NULL;
+    if (*block == NULL || (*block)->capacity - (*block)->used < length)
+    {
+        window_release_strings(block);
+        size_t capacity = length > WINDOW_STRINGS_BLOCK_SIZE ? length : WINDOW_STRINGS_BLOCK_SIZE;
+        *block = malloc(sizeof(WindowStrings) + capacity);
+        if (*block == NULL)
+        {
+            return 1;
+        }
+
+        (*block)->refs = 1;
+        (*block)->used = 0;
+        (*block)->capacity = capacity;
+    }
+
+    (*block)->refs++;
+    win->strings = *block;
+    return 0;
+}
+
+char *window_copy_string(Window *win, const char *string)
+{
+    if (string == NULL)
+    {
+        return NULL;
+    }
+
+    if (win->strings == NULL)
+    {
+        return strdup(string);
+    }
+
+    size_t length = strlen(string) + 1;
+    char *copy = win->strings->data + win->strings->used;
+    memcpy(copy, string, length);
+    win->strings->used += length;
+    return copy;
+}
+
+// drops one reference to the block, which is freed with its last one
+void window_release_strings(WindowStrings **block)
+{
+    if (*block != NULL && --(*block)->refs == 0)
+    {
+        free(*block);
+    }
+
+    *block = NULL;
+}
@@ -1,23 +1,53 @@
 #ifndef I3_EASYFOCUS_WIN
 #define I3_EASYFOCUS_WIN
 
+#include <stddef.h>
 #include <stdint.h>
 #include "win_type.h"
 
+// a block of strings shared by the windows copied into it, freed with the last
+typedef struct window_strings WindowStrings;
+
 typedef struct window
 {
     struct window *next;
     unsigned long id;
     uint32_t win_id;
     WindowType type;
+    int is_tab; // focusing a tab changes which windows are visible
+    int floating;
+    int hidden; // on a workspace that is not visible or in the scratchpad
+    size_t stacking; // position in the walk, floating windows are walked bottom to top
+    char *workspace;
+    char *output;
+    char *title;
+    char *class_name;
+    char *instance;
+    WindowStrings *strings; // holds the strings above if set, else each is freed on its own
+    struct
+    {
+        int x;
+        int y;
+    } position; // of the label, which may be moved apart from others
+    struct
+    {
+        int x;
+        int y;
+    } deco; // where the window's decoration starts, or its top left corner
     struct
     {
         int x;
         int y;
-    } position;
+        int width;
+        int height;
+    } rect; // screen area of the window including its decoration
 } Window;
 
 Window *window_append(Window *win, Window *item);
+size_t window_count(Window *win);
 void window_free(Window *win);
+int window_reserve_strings(Window *win, WindowStrings **block, size_t length);
+char *window_copy_string(Window *win, const char *string);
+void window_release_strings(WindowStrings **block);
 
 #endif
@@ -2,19 +2,67 @@
 #include "util.h"
 #include "config.h"
 #include "color_config.h"
+#include "trace.h"
+#include "probes.h"
+#include "record.h"
+#include "keymap.h"
+#include "loop.h"
+#include "cache.h"
 
 #include <stdlib.h>
 #include <string.h>
-#include <xcb/xcb_keysyms.h>
-#include <X11/Xlib.h>
+#include <time.h>
+#include <xcb/xkb.h>
 
-#define BUFFER 512
+#define LABEL_POOL_INITIAL_CAPACITY 16
+#define LABEL_POOL_SHRINK_FACTOR 4
+#define KEY_GRABS_INITIAL_CAPACITY 16
+
+typedef struct key_grab
+{
+    xcb_keysym_t keysym;
+    uint16_t mod_mask;
+    xcb_keycode_t keycodes[MAX_KEYCODES_PER_KEYSYM];
+    int count;
+} KeyGrab;
 
 static xcb_connection_t *connection = NULL;
 static xcb_screen_t *screen = NULL;
-static xcb_key_symbols_t *keysyms = NULL;
 static xcb_font_t font;
-static xcb_query_font_reply_t *font_info = NULL;
+static FontMetrics metrics;
+static xcb_gcontext_t gc = XCB_NONE;
+
+static KeyGrab *key_grabs = NULL;
+static size_t grabs_capacity = 0;
+static size_t grabs_length = 0;
+
+static xcb_window_t *label_pool = NULL;
+static size_t pool_capacity = 0;
+static size_t pool_size = 0;
+static size_t pool_used = 0;
+
+static xcb_window_t *watched_frames = NULL;
+static size_t watched_count = 0;
+
+// events that arrived while waiting for the expose of a new label, they are
+// handed to the main loop in their order before reading new ones
+static xcb_generic_event_t **deferred_events = NULL;
+static size_t deferred_capacity = 0;
+static size_t deferred_length = 0;
+static size_t deferred_next = 0;
+static int relayout_pending = 0;
+static long long relayout_pending_since = 0;
+static long long relayout_quiet_since = 0;
+
+// the font and the keyboard mapping of the last launch are used right away
+// and checked against the server once the labels are shown
+static Cache cache;
+static char cache_display[CACHE_MAX_NAME];
+static char cache_font_pattern[CACHE_MAX_NAME];
+static int cache_usable = 0;
+static int cache_dirty = 0;
+static int font_pending = 0;
+static xcb_query_font_cookie_t font_cookie;
 
 static uint32_t color_urgent_bg;
 static uint32_t color_focused_bg;
@@ -26,7 +74,10 @@ static uint32_t color_unfocused_fg;
 static int request_failed(xcb_void_cookie_t cookie, char *err_msg)
 {
     xcb_generic_error_t *err;
-    if ((err = xcb_request_check(connection, cookie)) != NULL)
+    trace_x_round_trip();
+    err = xcb_request_check(connection, cookie);
+    PROBE2(request_check, cookie.sequence, err != NULL ? err->error_code : 0);
+    if (err != NULL)
     {
         LOG("request failed: %s. error code: %d\n", err_msg, err->error_code);
         free(err);
@@ -58,59 +109,150 @@ static int grab_keycode(xcb_keycode_t keycode, uint16_t mod_mask)
            || grab_keycode_with_mod(keycode, mod_mask | XCB_MOD_MASK_2 | XCB_MOD_MASK_LOCK); // key with numlock and capslock
 }
 
-static xcb_char2b_t *string_to_char2b(const char *text, size_t len)
+static void ungrab_keycode(xcb_keycode_t keycode, uint16_t mod_mask)
 {
-    xcb_char2b_t *str = malloc(sizeof(xcb_char2b_t) * len);
+    LOG("ungrab key (keycode: %i)\n", keycode);
+    xcb_ungrab_key(connection, keycode, screen->root, mod_mask);
+    xcb_ungrab_key(connection, keycode, screen->root, mod_mask | XCB_MOD_MASK_2);
+    xcb_ungrab_key(connection, keycode, screen->root, mod_mask | XCB_MOD_MASK_LOCK);
+    xcb_ungrab_key(connection, keycode, screen->root, mod_mask | XCB_MOD_MASK_2 | XCB_MOD_MASK_LOCK);
+}
 
-    size_t i;
-    for (i = 0; i < len; i++)
+static int grab_keycodes(KeyGrab *grab)
+{
+    int i;
+    for (i = 0; i < grab->count; i++)
     {
-        str[i].byte1 = '\0';
-        str[i].byte2 = text[i];
+        LOG("translated keysym '%i' to keycode '%i'\n", grab->keysym, grab->keycodes[i]);
+        if (grab_keycode(grab->keycodes[i], grab->mod_mask))
+        {
+            LOG("failed to grab keycode '%i'\n", grab->keycodes[i]);
+            return 1;
+        }
     }
 
-    return str;
+    return 0;
 }
 
-static int predict_text_width(const char *text)
+static void ungrab_keycodes(KeyGrab *grab)
 {
-    size_t len = strlen(text);
-    xcb_char2b_t *str = string_to_char2b(text, len);
+    int i;
+    for (i = 0; i < grab->count; i++)
+    {
+        ungrab_keycode(grab->keycodes[i], grab->mod_mask);
+    }
+}
 
-    xcb_query_text_extents_cookie_t cookie = xcb_query_text_extents(connection, font, len, str);
-    xcb_query_text_extents_reply_t *reply = xcb_query_text_extents_reply(connection, cookie, NULL);
-    if (reply == NULL)
+/*
+ * Moves the grabs of all keysyms whose keycodes changed with the keymap or
+ * the active group, all other grabs stay untouched.
+ */
+static void update_key_grabs()
+{
+    size_t i;
+    for (i = 0; i < grabs_length; i++)
     {
-        fprintf(stderr, "cannot predict text width for '%s'\n", text);
-        free(str);
-        return font_info->max_bounds.character_width * len;
+        KeyGrab *grab = &key_grabs[i];
+        xcb_keycode_t keycodes[MAX_KEYCODES_PER_KEYSYM];
+        int count = keymap_keycodes(grab->keysym, keycodes, MAX_KEYCODES_PER_KEYSYM);
+        if (count == grab->count && memcmp(keycodes, grab->keycodes, count * sizeof(xcb_keycode_t)) == 0)
+        {
+            continue;
+        }
+
+        LOG("keycodes of keysym '%i' changed, regrabbing\n", grab->keysym);
+        ungrab_keycodes(grab);
+        memcpy(grab->keycodes, keycodes, count * sizeof(xcb_keycode_t));
+        grab->count = count;
+        if (grab_keycodes(grab))
+        {
+            LOG("cannot regrab keysym '%i'\n", grab->keysym);
+        }
     }
 
-    int width = reply->overall_width;
+    xcb_flush(connection);
+}
 
-    free(str);
-    free(reply);
-    return width;
+static void handle_keymap_event(xcb_generic_event_t *event)
+{
+    if (keymap_handle_event(event))
+    {
+        update_key_grabs();
+    }
 }
 
-static int draw_text(xcb_window_t window, int16_t x, int16_t y, uint32_t color_bg, uint32_t color_fg, const char *label)
+static void defer_event(xcb_generic_event_t *event)
 {
-    xcb_gcontext_t gc = xcb_generate_id(connection);
-    uint32_t mask = XCB_GC_FOREGROUND | XCB_GC_BACKGROUND | XCB_GC_FONT;
+    if (deferred_length == deferred_capacity)
+    {
+        size_t capacity = deferred_capacity == 0 ? 8 : deferred_capacity * 2;
+        xcb_generic_event_t **events = realloc(deferred_events, sizeof(xcb_generic_event_t *) * capacity);
+        if (events == NULL)
+        {
+            // the keymap must still follow the server
+            LOG("cannot defer event (type: %i)\n", event->response_type & ~0x80);
+            handle_keymap_event(event);
+            free(event);
+            return;
+        }
 
-    uint32_t value_list[3] = {color_fg, color_bg, font};
+        deferred_events = events;
+        deferred_capacity = capacity;
+    }
 
-    xcb_void_cookie_t gc_cookie = xcb_create_gc_checked(connection,
-                                                        gc,
-                                                        window,
-                                                        mask,
-                                                        value_list);
+    deferred_events[deferred_length++] = event;
+}
 
-    if (request_failed(gc_cookie, "cannot open gc"))
+static xcb_generic_event_t *next_deferred_event()
+{
+    if (deferred_next == deferred_length)
     {
-        return 1;
+        return NULL;
     }
 
+    xcb_generic_event_t *event = deferred_events[deferred_next++];
+    if (deferred_next == deferred_length)
+    {
+        deferred_next = 0;
+        deferred_length = 0;
+    }
+
+    return event;
+}
+
+static void free_deferred_events()
+{
+    xcb_generic_event_t *event;
+    while ((event = next_deferred_event()) != NULL)
+    {
+        free(event);
+    }
+
+    free(deferred_events);
+    deferred_events = NULL;
+    deferred_capacity = 0;
+}
+
+static int predict_text_width(const char *text)
+{
+    // single byte strings can be measured without asking the server
+    int width = 0;
+    const unsigned char *c;
+    for (c = (const unsigned char *) text; *c != '\0'; c++)
+    {
+        width += metrics.widths[*c] != 0 ? metrics.widths[*c] : metrics.max_width;
+    }
+
+    return width;
+}
+
+static int draw_text(xcb_window_t window, int16_t x, int16_t y, uint32_t color_bg, uint32_t color_fg, const char *label)
+{
+    // the graphics context is shared by all labels, see open_gc
+    uint32_t mask = XCB_GC_FOREGROUND | XCB_GC_BACKGROUND;
+    uint32_t value_list[2] = {color_fg, color_bg};
+    xcb_change_gc(connection, gc, mask, value_list);
+
     xcb_void_cookie_t text_cookie = xcb_image_text_8_checked(connection,
                                                              strlen(label),
                                                              window,
@@ -123,12 +265,6 @@ static int draw_text(xcb_window_t window, int16_t x, int16_t y, uint32_t color_b
         return 1;
     }
 
-    xcb_void_cookie_t gcfree_cookie = xcb_free_gc(connection, gc);
-    if (request_failed(gcfree_cookie, "cannot free gc"))
-    {
-        return 1;
-    }
-
     return 0;
 }
 
@@ -152,49 +288,133 @@ static int color_by_window_type(WindowType windowType, uint32_t* color_bg, uint3
     }
 }
 
-int xcb_create_text_window(int pos_x, int pos_y, WindowType windowType, const char *label)
+static int create_label_window(xcb_window_t *window)
 {
-    uint32_t mask;
-    uint32_t values[2];
-
-    int width = predict_text_width(label);
+    uint32_t mask = XCB_CW_BACK_PIXEL | XCB_CW_OVERRIDE_REDIRECT | XCB_CW_EVENT_MASK;
+    uint32_t values[3] = {color_unfocused_bg, 1, XCB_EVENT_MASK_EXPOSURE};
 
-    uint32_t color_bg, color_fg;
-    if (color_by_window_type(windowType, &color_bg, &color_fg)) {
-        LOG("cannot determine window colors\n");
-        return 1;
-    }
-
-    xcb_window_t window = xcb_generate_id(connection);
-    mask = XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK;
-    values[0] = color_bg;
-    values[1] = XCB_EVENT_MASK_EXPOSURE;
-
-    LOG("create window (id: %u, x: %i, y: %i): %s\n", window, pos_x, pos_y, label);
+    *window = xcb_generate_id(connection);
+    LOG("create label window (id: %u)\n", *window);
     xcb_void_cookie_t window_cookie =
         xcb_create_window_checked(connection,
                                   screen->root_depth,
-                                  window,
+                                  *window,
                                   screen->root,
-                                  pos_x,
-                                  pos_y,
-                                  width + 2,
-                                  font_info->font_ascent + font_info->font_descent,
+                                  0,
+                                  0,
+                                  1,
+                                  1,
                                   0,
                                   XCB_WINDOW_CLASS_INPUT_OUTPUT,
                                   screen->root_visual,
                                   mask,
                                   values);
 
-    if (request_failed(window_cookie, "cannot create window"))
+    return request_failed(window_cookie, "cannot create window");
+}
+
+static int acquire_label_window(xcb_window_t *window)
+{
+    if (pool_used == pool_size)
+    {
+        if (pool_size == pool_capacity)
+        {
+            size_t capacity = pool_capacity ? 2 * pool_capacity : LABEL_POOL_INITIAL_CAPACITY;
+            xcb_window_t *windows = realloc(label_pool, capacity * sizeof(xcb_window_t));
+            if (windows == NULL)
+            {
+                LOG("cannot grow label window pool\n");
+                return 1;
+            }
+
+            label_pool = windows;
+            pool_capacity = capacity;
+        }
+
+        if (create_label_window(&label_pool[pool_size]))
+        {
+            return 1;
+        }
+
+        pool_size++;
+    }
+
+    *window = label_pool[pool_used++];
+    return 0;
+}
+
+static void shrink_label_pool(size_t keep)
+{
+    if (keep < pool_used)
+    {
+        keep = pool_used;
+    }
+
+    while (pool_size > keep)
+    {
+        pool_size--;
+        LOG("destroy label window (id: %u)\n", label_pool[pool_size]);
+        xcb_destroy_window(connection, label_pool[pool_size]);
+    }
+}
+
+/*
+ * Keeps enough windows around for the usual number of labels, but doesn't
+ * hold on to the windows of a single, unusually large labeling pass.
+ */
+static void trim_label_pool()
+{
+    if (pool_size <= LABEL_POOL_INITIAL_CAPACITY || pool_size <= LABEL_POOL_SHRINK_FACTOR * pool_used)
+    {
+        return;
+    }
+
+    size_t keep = 2 * pool_used;
+    shrink_label_pool(keep < LABEL_POOL_INITIAL_CAPACITY ? LABEL_POOL_INITIAL_CAPACITY : keep);
+}
+
+static int place_label_window(xcb_window_t window, int pos_x, int pos_y, uint32_t color_bg, const char *label)
+{
+    int width = predict_text_width(label);
+
+    uint32_t bg_values[1] = {color_bg};
+    xcb_change_window_attributes(connection, window, XCB_CW_BACK_PIXEL, bg_values);
+
+    uint32_t mask = XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y | XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT | XCB_CONFIG_WINDOW_STACK_MODE;
+    uint32_t values[5] = {(uint32_t) pos_x,
+                          (uint32_t) pos_y,
+                          width + 2,
+                          metrics.ascent + metrics.descent,
+                          XCB_STACK_MODE_ABOVE};
+    xcb_void_cookie_t configure_cookie = xcb_configure_window_checked(connection, window, mask, values);
+
+    return request_failed(configure_cookie, "cannot configure window");
+}
+
+void xcb_label_size(int *width, int *height)
+{
+    // labels are single characters, see place_label_window
+    *width = metrics.max_width + 2;
+    *height = metrics.ascent + metrics.descent;
+}
+
+int xcb_create_text_window(int pos_x, int pos_y, WindowType windowType, const char *label, xcb_window_t *label_window)
+{
+    uint32_t color_bg, color_fg;
+    if (color_by_window_type(windowType, &color_bg, &color_fg)) {
+        LOG("cannot determine window colors\n");
+        return 1;
+    }
+
+    xcb_window_t window;
+    if (acquire_label_window(&window))
     {
         return 1;
     }
 
-    mask = XCB_CW_OVERRIDE_REDIRECT;
-    values[0] = 1;
-    xcb_void_cookie_t or_cookie = xcb_change_window_attributes(connection, window, mask, values);
-    if (request_failed(or_cookie, "cannot set override redirect"))
+    PROBE3(text_window_create, window, pos_x, pos_y);
+    LOG("show label window (id: %u, x: %i, y: %i): %s\n", window, pos_x, pos_y, label);
+    if (place_label_window(window, pos_x, pos_y, color_bg, label))
     {
         return 1;
     }
@@ -208,47 +428,104 @@ int xcb_create_text_window(int pos_x, int pos_y, WindowType windowType, const ch
     xcb_flush(connection);
 
     xcb_generic_event_t *event;
-    while (1)
+    while ((event = xcb_wait_for_event(connection)))
     {
-        if ((event = xcb_poll_for_event(connection)))
+        if ((event->response_type & ~0x80) == XCB_EXPOSE &&
+            ((xcb_expose_event_t *) event)->window == window)
         {
-            switch (event->response_type & ~0x80)
-            {
-            case XCB_EXPOSE:
+            free(event);
+            PROBE1(text_window_expose, window);
+            if (draw_text(window, 1, metrics.ascent, color_bg, color_fg, label))
             {
-                free(event);
-                if (draw_text(window, 1, font_info->font_ascent, color_bg, color_fg, label))
-                {
-                    LOG("error drawing text\n");
-                    return 1;
-                }
-
-                return 0;
-            }
+                LOG("error drawing text\n");
+                return 1;
             }
 
+            *label_window = window;
+            return 0;
+        }
+
+        // key presses and keymap changes may arrive before the expose, the
+        // main loop gets them in order once the labels are shown
+        if ((event->response_type & ~0x80) == XCB_EXPOSE)
+        {
             free(event);
         }
+        else
+        {
+            defer_event(event);
+        }
     }
+
+    LOG("connection closed while waiting for expose\n");
+    return 1;
 }
 
-char *xcb_keysym_to_string(xcb_keysym_t keysym)
+int xcb_update_text_window(xcb_window_t window, int pos_x, int pos_y, WindowType windowType, const char *label)
 {
-    //TODO: this is not really the correct string representation of the key
-    char *key = XKeysymToString(keysym);
-    if (key == NULL)
+    uint32_t color_bg, color_fg;
+    if (color_by_window_type(windowType, &color_bg, &color_fg)) {
+        LOG("cannot determine window colors\n");
+        return 1;
+    }
+
+    LOG("update label window (id: %u, x: %i, y: %i): %s\n", window, pos_x, pos_y, label);
+    if (place_label_window(window, pos_x, pos_y, color_bg, label))
     {
-        return NULL;
+        return 1;
     }
 
-    char *key_buf = malloc(BUFFER);
-    strncpy(key_buf, key, BUFFER - 1);
-    key_buf[BUFFER - 1] = '\0';
+    // the window is already mapped, so it can be repainted right away
+    // instead of waiting for an expose event.
+    xcb_clear_area(connection, 0, window, 0, 0, 0, 0);
+    if (draw_text(window, 1, metrics.ascent, color_bg, color_fg, label))
+    {
+        LOG("error drawing text\n");
+        return 1;
+    }
 
-    return key_buf;
+    xcb_flush(connection);
+    return 0;
 }
 
+void xcb_hide_text_window(xcb_window_t window)
+{
+    size_t i;
+    for (i = 0; i < pool_used; i++)
+    {
+        if (label_pool[i] == window)
+        {
+            LOG("hide label window (id: %u)\n", window);
+            label_pool[i] = label_pool[pool_used - 1];
+            label_pool[pool_used - 1] = window;
+            pool_used--;
+
+            xcb_unmap_window(connection, window);
+            trim_label_pool();
+            xcb_flush(connection);
+            return;
+        }
+    }
+
+    LOG("label window %u is not in use\n", window);
+}
+
+void xcb_clear_labels()
+{
+    LOG("hide %lu label windows (pool size: %lu)\n", pool_used, pool_size);
+    size_t i;
+    for (i = 0; i < pool_used; i++)
+    {
+        xcb_unmap_window(connection, label_pool[i]);
+    }
+
+    pool_used = 0;
+    trim_label_pool();
 
+    xcb_ungrab_key(connection, XCB_GRAB_ANY, screen->root, XCB_MOD_MASK_ANY);
+    grabs_length = 0;
+    xcb_flush(connection);
+}
 
 static uint16_t modifier_string_to_mask_fn(char *modifier, size_t size)
 {
@@ -293,34 +570,210 @@ uint16_t xcb_modifier_string_to_mask(char *modifier)
 int xcb_grab_keysym(xcb_keysym_t keysym, uint16_t mod_mask)
 {
     LOG("try to grab key (keysym: %i, modifier: %i)\n", keysym, mod_mask);
-    xcb_keycode_t min_keycode = xcb_get_setup(connection)->min_keycode;
-    xcb_keycode_t max_keycode = xcb_get_setup(connection)->max_keycode;
+    if (grabs_length == grabs_capacity)
+    {
+        size_t capacity = grabs_capacity ? 2 * grabs_capacity : KEY_GRABS_INITIAL_CAPACITY;
+        KeyGrab *grabs = realloc(key_grabs, capacity * sizeof(KeyGrab));
+        if (grabs == NULL)
+        {
+            LOG("cannot grow key grabs\n");
+            return 1;
+        }
+
+        key_grabs = grabs;
+        grabs_capacity = capacity;
+    }
 
-    xcb_keycode_t i;
-    int foundCode = 0;
-    for (i = min_keycode; i && i < max_keycode; i++)
+    KeyGrab *grab = &key_grabs[grabs_length];
+    grab->keysym = keysym;
+    grab->mod_mask = mod_mask;
+    grab->count = keymap_keycodes(keysym, grab->keycodes, MAX_KEYCODES_PER_KEYSYM);
+    if (grab->count == 0)
     {
-        if (xcb_key_symbols_get_keysym(keysyms, i, 0) != keysym)
+        LOG("cannot find keycode for keysym '%i' in the active group\n", keysym);
+        return 1;
+    }
+
+    if (grab_keycodes(grab))
+    {
+        return 1;
+    }
+
+    grabs_length++;
+    return 0;
+}
+
+void xcb_ungrab_keysym(xcb_keysym_t keysym, uint16_t mod_mask)
+{
+    LOG("ungrab key (keysym: %i, modifier: %i)\n", keysym, mod_mask);
+    size_t i;
+    for (i = 0; i < grabs_length; i++)
+    {
+        if (key_grabs[i].keysym == keysym && key_grabs[i].mod_mask == mod_mask)
         {
-            continue;
+            ungrab_keycodes(&key_grabs[i]);
+            key_grabs[i] = key_grabs[--grabs_length];
+            break;
         }
+    }
+
+    xcb_flush(connection);
+}
 
-        LOG("translated keysym '%i' to keycode '%i'\n", keysym, i);
-        foundCode = 1;
-        if (grab_keycode(i, mod_mask))
+/*
+ * Grabs the whole keyboard, so that any key can be typed. The key binding
+ * that started us may still be held, which keeps i3's own grab active for a
+ * moment, so the grab is retried for a while.
+ */
+int xcb_grab_keyboard_input()
+{
+    int attempt;
+    for (attempt = 0; attempt < KEYBOARD_GRAB_ATTEMPTS; attempt++)
+    {
+        xcb_grab_keyboard_cookie_t cookie = xcb_grab_keyboard(connection,
+                                                              1,
+                                                              screen->root,
+                                                              XCB_CURRENT_TIME,
+                                                              XCB_GRAB_MODE_ASYNC,
+                                                              XCB_GRAB_MODE_ASYNC);
+        xcb_grab_keyboard_reply_t *reply = xcb_grab_keyboard_reply(connection, cookie, NULL);
+        trace_x_round_trip();
+        int status = reply == NULL ? -1 : reply->status;
+        free(reply);
+        if (status == XCB_GRAB_STATUS_SUCCESS)
+        {
+            return 0;
+        }
+
+        LOG("cannot grab keyboard (status: %i), retrying\n", status);
+        struct timespec delay = {0, KEYBOARD_GRAB_RETRY_MS * 1000000L};
+        nanosleep(&delay, NULL);
+    }
+
+    return 1;
+}
+
+static long long monotonic_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static int is_label_window(xcb_window_t window)
+{
+    size_t i;
+    for (i = 0; i < pool_size; i++)
+    {
+        if (label_pool[i] == window)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int is_watched_frame(xcb_window_t window)
+{
+    if (watched_count == 0)
+    {
+        return 1;
+    }
+
+    size_t i;
+    for (i = 0; i < watched_count; i++)
+    {
+        if (watched_frames[i] == window)
         {
-            LOG("failed to grab keycode '%i'\n", i);
             return 1;
         }
     }
 
-    if (foundCode)
+    return 0;
+}
+
+/*
+ * Grabbed keys are looked up without the modifiers they were grabbed with, so
+ * that capslock, numlock and --modifier select the label's keysym. Any other
+ * key, e.g. while the keyboard is grabbed for filtering, keeps its level.
+ */
+static uint16_t lookup_state(xcb_keycode_t keycode, uint16_t state)
+{
+    size_t i;
+    int k;
+    for (i = 0; i < grabs_length; i++)
+    {
+        for (k = 0; k < key_grabs[i].count; k++)
+        {
+            if (key_grabs[i].keycodes[k] == keycode)
+            {
+                return state & ~(key_grabs[i].mod_mask | XCB_MOD_MASK_LOCK | XCB_MOD_MASK_2);
+            }
+        }
+    }
+
+    return state;
+}
+
+static int configure_affects_labels(xcb_configure_notify_event_t *cn)
+{
+    // our own labels, tooltips, notifications and the like are not managed
+    // by i3, so they never move any of the labelled windows.
+    if (cn->override_redirect || is_label_window(cn->window))
     {
         return 0;
     }
 
-    LOG("cannot find keycode for keysym '%i' in first column\n", keysym);
-    return 1;
+    return is_watched_frame(cn->window);
+}
+
+/*
+ * Waits for the next event, or for events from i3, without blocking on the
+ * X connection alone. While a relayout is pending, it only waits until the
+ * configure notify burst has been quiet for long enough. Returns NULL if
+ * there is no event, setting ipc_ready if i3's events were dispatched.
+ */
+static xcb_generic_event_t *next_event(int *ipc_ready)
+{
+    xcb_generic_event_t *deferred = next_deferred_event();
+    if (deferred != NULL)
+    {
+        return deferred;
+    }
+
+    xcb_flush(connection);
+    while (1)
+    {
+        xcb_generic_event_t *event = xcb_poll_for_event(connection);
+        if (event != NULL || xcb_connection_has_error(connection))
+        {
+            return event;
+        }
+
+        int timeout = -1;
+        if (relayout_pending)
+        {
+            long long now = monotonic_ms();
+            long long deadline = relayout_quiet_since + CONFIGURE_NOTIFY_QUIET_MS;
+            if (relayout_pending_since + CONFIGURE_NOTIFY_MAX_DELAY_MS < deadline)
+            {
+                deadline = relayout_pending_since + CONFIGURE_NOTIFY_MAX_DELAY_MS;
+            }
+
+            if (now >= deadline)
+            {
+                return NULL;
+            }
+            timeout = (int) (deadline - now);
+        }
+
+        if (loop_wait(timeout) & LOOP_IPC_DISPATCHED)
+        {
+            *ipc_ready = 1;
+            return NULL;
+        }
+    }
 }
 
 xcb_keysym_t xcb_wait_for_user_input()
@@ -328,26 +781,57 @@ xcb_keysym_t xcb_wait_for_user_input()
     LOG("waiting for xcb event\n");
     xcb_generic_event_t *event;
     int focused_in = 0;
-    while ((event = xcb_wait_for_event(connection)))
+    while (1)
     {
+        int ipc_ready = 0;
+        event = next_event(&ipc_ready);
+        if (event == NULL)
+        {
+            if (xcb_connection_has_error(connection))
+            {
+                break;
+            }
+
+            if (ipc_ready)
+            {
+                LOG("i3 events dispatched\n");
+                return XCB_IPC_EVENTS;
+            }
+
+            LOG("configure notify burst is over, relayout\n");
+            relayout_pending = 0;
+            return XCB_NO_SYMBOL;
+        }
+
+        record_x_event(event);
         switch (event->response_type & ~0x80)
         {
         case XCB_KEY_PRESS:
         {
             xcb_key_press_event_t *kp = (xcb_key_press_event_t *) event;
 
-            xcb_keysym_t sym = xcb_key_press_lookup_keysym(keysyms, kp, 0);
+            xcb_keysym_t sym = keymap_lookup(kp->detail, lookup_state(kp->detail, kp->state));
             LOG("key press event (keycode: %i, keysym: %i)\n", kp->detail, sym);
+            PROBE3(key_press, kp->detail, sym, kp->time);
+            record_key_press(kp, sym);
 
             free(event);
             return sym;
         }
         case XCB_CONFIGURE_NOTIFY:
         {
-            LOG("configure notify event\n");
-
-            free(event);
-            return XCB_NO_SYMBOL;
+            xcb_configure_notify_event_t *cn = (xcb_configure_notify_event_t *) event;
+            if (configure_affects_labels(cn))
+            {
+                LOG("configure notify event (window: %u)\n", cn->window);
+                relayout_quiet_since = monotonic_ms();
+                if (!relayout_pending)
+                {
+                    relayout_pending = 1;
+                    relayout_pending_since = relayout_quiet_since;
+                }
+            }
+            break;
         }
         case XCB_FOCUS_OUT:
         {
@@ -365,12 +849,53 @@ xcb_keysym_t xcb_wait_for_user_input()
             focused_in = 1;
             break;
         }
+        default:
+            handle_keymap_event(event);
+            break;
         }
 
         free(event);
     }
 
-    return 1;
+    LOG("lost the X connection\n");
+    return XCB_CONNECTION_LOST;
+}
+
+void xcb_watch_windows(const uint32_t *win_ids, size_t count)
+{
+    free(watched_frames);
+    watched_frames = NULL;
+    watched_count = 0;
+    if (count == 0)
+    {
+        return;
+    }
+
+    // i3 reparents every client into a frame, which is the window that shows
+    // up in the configure notify events on the root window.
+    xcb_query_tree_cookie_t *cookies = malloc(count * sizeof(xcb_query_tree_cookie_t));
+    size_t i;
+    for (i = 0; i < count; i++)
+    {
+        cookies[i] = xcb_query_tree(connection, win_ids[i]);
+    }
+
+    watched_frames = malloc(count * sizeof(xcb_window_t));
+    trace_x_round_trip();
+    for (i = 0; i < count; i++)
+    {
+        xcb_query_tree_reply_t *reply = xcb_query_tree_reply(connection, cookies[i], NULL);
+        if (reply == NULL)
+        {
+            continue;
+        }
+
+        watched_frames[watched_count++] = reply->parent == screen->root ? win_ids[i] : reply->parent;
+        free(reply);
+    }
+
+    free(cookies);
+    LOG("watching %lu frames for configure notify events\n", watched_count);
 }
 
 int xcb_register_configure_notify()
@@ -400,42 +925,48 @@ static xcb_alloc_color_cookie_t alloc_color(xcb_colormap_t colormap_id, Rgb rgb)
 
 static int open_colors(ColorConfig cfg)
 {
-    xcb_colormap_t colormap_id = xcb_generate_id(connection);
-    xcb_void_cookie_t open_colormap = xcb_create_colormap_checked(connection, XCB_COLORMAP_ALLOC_NONE, colormap_id, screen->root, screen->root_visual);
-    if (request_failed(open_colormap, "cannot open colormap"))
+    // allocating in the default colormap doesn't create a server resource
+    // that would have to be freed again
+    xcb_colormap_t colormap_id = screen->default_colormap;
+
+    xcb_alloc_color_cookie_t cookies[6] = {
+        alloc_color(colormap_id, cfg.urgent_bg),
+        alloc_color(colormap_id, cfg.focused_bg),
+        alloc_color(colormap_id, cfg.unfocused_bg),
+        alloc_color(colormap_id, cfg.urgent_fg),
+        alloc_color(colormap_id, cfg.focused_fg),
+        alloc_color(colormap_id, cfg.unfocused_fg)};
+    uint32_t *pixels[6] = {
+        &color_urgent_bg,
+        &color_focused_bg,
+        &color_unfocused_bg,
+        &color_urgent_fg,
+        &color_focused_fg,
+        &color_unfocused_fg};
+
+    trace_x_round_trip();
+    int failed = 0;
+    size_t i;
+    for (i = 0; i < 6; i++)
     {
-        return 1;
+        xcb_alloc_color_reply_t *reply = xcb_alloc_color_reply(connection, cookies[i], NULL);
+        if (reply == NULL)
+        {
+            // keep collecting the replies, so that none is left in the queue
+            failed = 1;
+            continue;
+        }
+
+        *pixels[i] = reply->pixel;
+        free(reply);
     }
 
-    xcb_alloc_color_cookie_t urgent_bg_cookie = alloc_color(colormap_id, cfg.urgent_bg);
-    xcb_alloc_color_cookie_t focused_bg_cookie = alloc_color(colormap_id, cfg.focused_bg);
-    xcb_alloc_color_cookie_t unfocused_bg_cookie = alloc_color(colormap_id, cfg.unfocused_bg);
-    xcb_alloc_color_cookie_t urgent_fg_cookie = alloc_color(colormap_id, cfg.urgent_fg);
-    xcb_alloc_color_cookie_t focused_fg_cookie = alloc_color(colormap_id, cfg.focused_fg);
-    xcb_alloc_color_cookie_t unfocused_fg_cookie = alloc_color(colormap_id, cfg.unfocused_fg);
-
-    xcb_alloc_color_reply_t *urgent_bg_reply = xcb_alloc_color_reply(connection, urgent_bg_cookie, NULL);
-    xcb_alloc_color_reply_t *focused_bg_reply = xcb_alloc_color_reply(connection, focused_bg_cookie, NULL);
-    xcb_alloc_color_reply_t *unfocused_bg_reply = xcb_alloc_color_reply(connection, unfocused_bg_cookie, NULL);
-    xcb_alloc_color_reply_t *urgent_fg_reply = xcb_alloc_color_reply(connection, urgent_fg_cookie, NULL);
-    xcb_alloc_color_reply_t *focused_fg_reply = xcb_alloc_color_reply(connection, focused_fg_cookie, NULL);
-    xcb_alloc_color_reply_t *unfocused_fg_reply = xcb_alloc_color_reply(connection, unfocused_fg_cookie, NULL);
-
-    color_urgent_bg = urgent_bg_reply->pixel;
-    color_focused_bg = focused_bg_reply->pixel;
-    color_unfocused_bg = unfocused_bg_reply->pixel;
-    color_urgent_fg = urgent_fg_reply->pixel;
-    color_focused_fg = focused_fg_reply->pixel;
-    color_unfocused_fg = unfocused_fg_reply->pixel;
-
-    free(urgent_bg_reply);
-    free(focused_bg_reply);
-    free(unfocused_bg_reply);
-    free(urgent_fg_reply);
-    free(focused_fg_reply);
-    free(unfocused_fg_reply);
+    if (failed)
+    {
+        LOG("cannot allocate colors\n");
+    }
 
-    return 0;
+    return failed;
 }
 
 static int open_font(const char *font_pattern)
@@ -446,7 +977,14 @@ static int open_font(const char *font_pattern)
                                                      strlen(font_pattern),
                                                      font_pattern);
 
-    return request_failed(cookie, "cannot open font");
+    if (request_failed(cookie, "cannot open font"))
+    {
+        return 1;
+    }
+
+    strncpy(cache.font_name, font_pattern, CACHE_MAX_NAME - 1);
+    cache.font_name[CACHE_MAX_NAME - 1] = '\0';
+    return 0;
 }
 
 static int open_font_with_fallback(const char *font_name)
@@ -462,41 +1000,251 @@ static int open_font_with_fallback(const char *font_name)
     return 0;
 }
 
+static void metrics_from_reply(xcb_query_font_reply_t *reply, FontMetrics *m)
+{
+    memset(m, 0, sizeof(FontMetrics));
+    m->ascent = reply->font_ascent;
+    m->descent = reply->font_descent;
+    m->max_width = reply->max_bounds.character_width;
+
+    // without per character metrics, all characters have the maximum width.
+    // otherwise the first row holds the characters of single byte strings.
+    xcb_charinfo_t *infos = xcb_query_font_char_infos(reply);
+    int length = xcb_query_font_char_infos_length(reply);
+    if (length == 0 || reply->min_byte1 != 0)
+    {
+        return;
+    }
+
+    int c;
+    for (c = reply->min_char_or_byte2; c <= reply->max_char_or_byte2 && c < 256; c++)
+    {
+        int index = c - reply->min_char_or_byte2;
+        if (index < length && infos[index].character_width > 0)
+        {
+            m->widths[c] = infos[index].character_width;
+        }
+    }
+}
+
+static int query_font()
+{
+    xcb_query_font_cookie_t cookie = xcb_query_font(connection, font);
+    xcb_query_font_reply_t *reply = xcb_query_font_reply(connection, cookie, NULL);
+    trace_x_round_trip();
+    if (reply == NULL)
+    {
+        return 1;
+    }
+
+    metrics_from_reply(reply, &metrics);
+    free(reply);
+    return 0;
+}
+
+static int open_gc()
+{
+    gc = xcb_generate_id(connection);
+    uint32_t value_list[1] = {font};
+    xcb_void_cookie_t cookie = xcb_create_gc_checked(connection, gc, screen->root, XCB_GC_FONT, value_list);
+    if (request_failed(cookie, "cannot open gc"))
+    {
+        gc = XCB_NONE;
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * The cached font is opened without waiting for the server: creating the
+ * graphics context with it fails if it is gone, and its metrics are checked
+ * by xcb_sync_cache.
+ */
+static int open_cached_font()
+{
+    font = xcb_generate_id(connection);
+    xcb_open_font(connection, font, strlen(cache.font_name), cache.font_name);
+    font_cookie = xcb_query_font(connection, font);
+    font_pending = 1;
+    metrics = cache.metrics;
+
+    if (open_gc())
+    {
+        LOG("cached font cannot be used: %s\n", cache.font_name);
+        xcb_discard_reply(connection, font_cookie.sequence);
+        font_pending = 0;
+        xcb_close_font(connection, font);
+        return 1;
+    }
+
+    return 0;
+}
+
+static int open_font_and_gc(const char *font_name, int cached)
+{
+    if (cached && open_cached_font() == 0)
+    {
+        return 0;
+    }
+
+    cache_dirty = 1;
+    if (open_font_with_fallback(font_name))
+    {
+        return 1;
+    }
+
+    if (query_font() || open_gc())
+    {
+        LOG("cannot set up font\n");
+        xcb_close_font(connection, font);
+        return 1;
+    }
+
+    return 0;
+}
+
 int xcb_init(const char *font_name, ColorConfig color_config)
 {
     connection = xcb_connect(NULL, NULL);
     if (xcb_connection_has_error(connection))
     {
-        LOG("cannot open display");
+        LOG("cannot open display\n");
+        xcb_disconnect(connection);
+        connection = NULL;
         return 1;
     }
 
+    const char *display = getenv("DISPLAY");
+    display = display != NULL ? display : "";
+    cache_usable = strlen(display) < CACHE_MAX_NAME && strlen(font_name) < CACHE_MAX_NAME;
+    int cached = 0;
+    if (cache_usable)
+    {
+        strcpy(cache_display, display);
+        strcpy(cache_font_pattern, font_name);
+        cached = (cache_load(cache_display, cache_font_pattern, &cache) == 0);
+    }
+    if (cached)
+    {
+        trace_cached();
+    }
+    cache_dirty = !cached;
+
     screen = xcb_setup_roots_iterator(xcb_get_setup(connection)).data;
-    keysyms = xcb_key_symbols_alloc(connection);
+    const xcb_setup_t *setup = xcb_get_setup(connection);
+    if (cached && cache.keysyms != NULL && (cache.min_keycode != setup->min_keycode || cache.max_keycode != setup->max_keycode))
+    {
+        // the keymap loads the mapping from the server instead
+        cache_dirty = 1;
+    }
+    int keymap_failed = keymap_init(connection, cached ? &cache : NULL);
 
-    if (open_colors(color_config))
+    // the keyboard mapping was copied, the font name and metrics are kept
+    cache_free(&cache);
+    if (keymap_failed)
     {
         xcb_disconnect(connection);
         return 1;
     }
 
-    if (open_font_with_fallback(font_name))
+    if (loop_init(xcb_get_file_descriptor(connection)))
     {
+        keymap_free();
         xcb_disconnect(connection);
         return 1;
     }
 
-    xcb_query_font_cookie_t font_cookie = xcb_query_font(connection, font);
-    font_info = xcb_query_font_reply(connection, font_cookie, NULL);
+    if (open_colors(color_config) || open_font_and_gc(font_name, cached))
+    {
+        loop_finish();
+        keymap_free();
+        xcb_disconnect(connection);
+        return 1;
+    }
 
     return 0;
 }
 
+void xcb_sync_cache()
+{
+    if (keymap_verify())
+    {
+        update_key_grabs();
+        cache_dirty = 1;
+    }
+
+    int relayout = 0;
+    if (font_pending)
+    {
+        font_pending = 0;
+        xcb_query_font_reply_t *reply = xcb_query_font_reply(connection, font_cookie, NULL);
+        trace_x_round_trip();
+        if (reply != NULL)
+        {
+            FontMetrics fresh;
+            metrics_from_reply(reply, &fresh);
+            free(reply);
+            if (memcmp(&fresh, &metrics, sizeof(FontMetrics)) != 0)
+            {
+                LOG("cached font metrics are outdated\n");
+                metrics = fresh;
+                cache_dirty = 1;
+                relayout = 1;
+            }
+        }
+    }
+
+    if (cache_usable && cache_dirty)
+    {
+        cache.metrics = metrics;
+        keymap_export(&cache);
+        cache_store(cache_display, cache_font_pattern, &cache);
+
+        // the table belongs to the keymap
+        cache.keysyms = NULL;
+        cache_dirty = 0;
+    }
+
+    if (relayout)
+    {
+        // labels are sized with the new metrics as soon as possible
+        relayout_pending = 1;
+        relayout_pending_since = monotonic_ms() - CONFIGURE_NOTIFY_MAX_DELAY_MS;
+        relayout_quiet_since = relayout_pending_since;
+    }
+}
+
 void xcb_finish()
 {
-    free(font_info);
+    pool_used = 0;
+    shrink_label_pool(0);
+    free(label_pool);
+    label_pool = NULL;
+    pool_capacity = 0;
+
+    free(watched_frames);
+    watched_frames = NULL;
+    watched_count = 0;
+    relayout_pending = 0;
+    free_deferred_events();
+
+    if (font_pending)
+    {
+        xcb_discard_reply(connection, font_cookie.sequence);
+        font_pending = 0;
+    }
+
+    xcb_free_gc(connection, gc);
+    gc = XCB_NONE;
     xcb_close_font(connection, font);
-    xcb_key_symbols_free(keysyms);
+    keymap_free();
+    loop_finish();
+    free(key_grabs);
+    key_grabs = NULL;
+    grabs_capacity = 0;
+    grabs_length = 0;
+    xcb_ungrab_keyboard(connection, XCB_CURRENT_TIME);
     xcb_disconnect(connection);
     connection = NULL;
 }
@@ -4,13 +4,25 @@
 #include <xcb/xcb.h>
 #include "win_type.h"
 
+// returned by xcb_wait_for_user_input when i3 sent events, keysyms only use 29 bits
+#define XCB_IPC_EVENTS ((xcb_keysym_t) 0x20000000)
+// returned by xcb_wait_for_user_input when the X connection is gone
+#define XCB_CONNECTION_LOST ((xcb_keysym_t) 0x20000001)
+
 int xcb_init();
-char *xcb_keysym_to_string(xcb_keysym_t keysym);
 int xcb_register_configure_notify();
 uint16_t xcb_modifier_string_to_mask(char *modifier);
 int xcb_grab_keysym(xcb_keysym_t keysym, uint16_t mod_mask);
+void xcb_ungrab_keysym(xcb_keysym_t keysym, uint16_t mod_mask);
+int xcb_grab_keyboard_input();
 xcb_keysym_t xcb_wait_for_user_input();
-int xcb_create_text_window(int pos_x, int pos_y, WindowType windowType, const char* label);
+void xcb_watch_windows(const uint32_t *win_ids, size_t count);
+void xcb_label_size(int *width, int *height);
+int xcb_create_text_window(int pos_x, int pos_y, WindowType windowType, const char* label, xcb_window_t *label_window);
+int xcb_update_text_window(xcb_window_t window, int pos_x, int pos_y, WindowType windowType, const char* label);
+void xcb_hide_text_window(xcb_window_t window);
+void xcb_clear_labels();
+void xcb_sync_cache();
 void xcb_finish();
 
 #endif